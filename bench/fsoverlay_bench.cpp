@@ -0,0 +1,199 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+// Benchmark of the overlay config management at scale:
+// generates an override directory with the real files,
+// the symlinks under Data and the related config, then
+// times the fso functions and reports the peak RSS
+//
+// Usage: fsoverlay-bench [plugins] [entries] [conflict %] [rescans] [work dir]
+//
+// 'conflict %' is the share of entries of each plugin
+// which are provided by all the plugins, 'rescans' the
+// number of plugins scan_plugin and list_remove get
+// timed on; work dir must not exist and is left in place
+// (a temporary one gets removed at the end)
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <libxml/parser.h>
+#include "fsoverlay.h"
+#include "utils.h"
+
+namespace {
+	double elapsed_ms(const std::chrono::steady_clock::time_point& start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	long peak_rss_kib(void) {
+		struct rusage	ru = {};
+		getrusage(RUSAGE_SELF, &ru);
+		return ru.ru_maxrss;
+	}
+
+	std::string entry_path(const int p, const int e, const int conflict_pct) {
+		std::ostringstream	sstr;
+		if((e%100) < conflict_pct)
+			sstr << "textures/shared";
+		else
+			sstr << "textures/p" << p;
+		sstr << "/d" << (e/100) << "/f" << e << ".dds";
+		return sstr.str();
+	}
+
+	std::string p_name(const int p) {
+		return "plugin" + std::to_string(p) + ".7z";
+	}
+
+	// writes the real files, the Data symlinks (to the
+	// winning plugin) and the config; returns entries
+	size_t generate(const std::string& work_dir, const std::string& xml, const int n_plugins, const int n_entries, const int conflict_pct) {
+		const std::string	data_dir = work_dir + "Data/",
+					ovd_dir = work_dir + "ovd/";
+		utils::ensure_fname_path(xml);
+		std::ofstream		ostr(xml);
+		size_t			rv = 0;
+		ostr << "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n<skyrim-pm-fsoverlay-config>";
+		for(int p = 0; p < n_plugins; ++p) {
+			ostr << "<plugin name=\"" << p_name(p) << "\">";
+			for(int e = 0; e < n_entries; ++e) {
+				const auto	rel = entry_path(p, e, conflict_pct),
+						r_file = ovd_dir + p_name(p) + '/' + rel,
+						sym_file = data_dir + rel;
+				utils::ensure_fname_path(r_file);
+				std::ofstream(r_file).put('x');
+				// later plugins win
+				utils::ensure_fname_path(sym_file);
+				unlink(sym_file.c_str());
+				if(symlink(r_file.c_str(), sym_file.c_str()))
+					throw std::runtime_error(std::string("Can't create symlink '") + sym_file + "'");
+				ostr << "<entry fspath=\"" << r_file << "\" datapath=\"" << rel << "\"/>";
+				++rv;
+			}
+			ostr << "</plugin>\n";
+		}
+		ostr << "</skyrim-pm-fsoverlay-config>\n";
+		if(!ostr)
+			throw std::runtime_error(std::string("Can't write config '") + xml + "'");
+		return rv;
+	}
+
+	int rm_entry(const char* f, const struct stat*, int, struct FTW*) {
+		return remove(f);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		const int	n_plugins = (argc > 1) ? std::atoi(argv[1]) : 100,
+				n_entries = (argc > 2) ? std::atoi(argv[2]) : 1000,
+				conflict_pct = (argc > 3) ? std::atoi(argv[3]) : 20,
+				n_rescans = (argc > 4) ? std::atoi(argv[4]) : 5;
+		if(n_plugins <= 0 || n_entries <= 0 || conflict_pct < 0 || conflict_pct > 100 || n_rescans < 0 || n_rescans > n_plugins)
+			throw std::runtime_error("Invalid arguments");
+		std::string	work_dir;
+		const bool	tmp_dir = (argc <= 5);
+		if(tmp_dir) {
+			char	tmpl[] = "/tmp/skyrim-pm-fso-XXXXXX";
+			if(!mkdtemp(tmpl))
+				throw std::runtime_error("Can't create temporary directory");
+			work_dir = tmpl;
+		} else {
+			work_dir = argv[5];
+			if(mkdir(work_dir.c_str(), S_IRWXU))
+				throw std::runtime_error(std::string("Can't create work directory '") + work_dir + "', it must not exist");
+		}
+		work_dir += '/';
+		const std::string	data_dir = work_dir + "Data/",
+					xml = data_dir + "skyrim-pm-fso.xml",
+					xml_upd = work_dir + "skyrim-pm-fso-upd.xml";
+		std::ostringstream	null_out;
+
+		auto		start = std::chrono::steady_clock::now();
+		const auto	n_tot = generate(work_dir, xml, n_plugins, n_entries, conflict_pct);
+		std::cout	<< "Overlay: " << n_plugins << " plugins, " << n_entries << " entries/plugin, " << conflict_pct << "% conflicting ("
+				<< n_tot << " entries) in '" << work_dir << "'\n"
+				<< "generate\t" << elapsed_ms(start) << " ms" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		fso::load_xml(xml);
+		std::cout << "load_xml\t" << elapsed_ms(start) << " ms" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		fso::update_xml(xml_upd);
+		std::cout << "update_xml\t" << elapsed_ms(start) << " ms" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		fso::list_replace(null_out);
+		std::cout << "list_replace\t" << elapsed_ms(start) << " ms (" << null_out.str().size()/1024 << " KiB output)" << std::endl;
+		null_out.str("");
+
+		start = std::chrono::steady_clock::now();
+		fso::list_verify(null_out, data_dir);
+		std::cout << "list_verify\t" << elapsed_ms(start) << " ms (" << null_out.str().size()/1024 << " KiB output)" << std::endl;
+		null_out.str("");
+
+		// the first run records the fingerprints,
+		// the second one only compares them
+		size_t	fp_updated = 0;
+		start = std::chrono::steady_clock::now();
+		fso::list_verify(null_out, data_dir, 0, &fp_updated);
+		std::cout << "list_verify_fp\t" << elapsed_ms(start) << " ms (" << fp_updated << " fingerprints recorded)" << std::endl;
+		null_out.str("");
+		fp_updated = 0;
+		start = std::chrono::steady_clock::now();
+		fso::list_verify(null_out, data_dir, 0, &fp_updated);
+		std::cout << "list_verify_fp\t" << elapsed_ms(start) << " ms (" << fp_updated << " fingerprints changed)" << std::endl;
+		null_out.str("");
+
+		if(n_rescans) {
+			// each scan walks the plugin files only
+			start = std::chrono::steady_clock::now();
+			for(int p = n_plugins - n_rescans; p < n_plugins; ++p)
+				fso::scan_plugin(p_name(p) + ".rescan", work_dir + "ovd/" + p_name(p) + '/', data_dir, [](const std::string& f) { return f; });
+			std::cout << "scan_plugin\t" << elapsed_ms(start)/n_rescans << " ms/plugin" << std::endl;
+			fso::reset();
+			fso::load_xml(xml);
+
+			std::vector<std::string>	p_names;
+			for(int p = 0; p < n_rescans; ++p)
+				p_names.push_back(p_name(p));
+			start = std::chrono::steady_clock::now();
+			fso::list_remove(null_out, p_names, data_dir, work_dir + "ovd/");
+			std::cout << "list_remove\t" << elapsed_ms(start) << " ms (" << n_rescans << " plugins)" << std::endl;
+		}
+
+		std::cout << "peak RSS\t" << peak_rss_kib()/1024 << " MiB" << std::endl;
+		xmlCleanupParser();
+		if(tmp_dir)
+			nftw(work_dir.c_str(), rm_entry, 64, FTW_DEPTH|FTW_PHYS);
+	} catch(const std::exception& e) {
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+}
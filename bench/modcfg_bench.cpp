@@ -0,0 +1,118 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+// Benchmark of ModuleConfig compilation and evaluation
+// on a large generated ModuleConfig; no archive is used
+// and all the groups are answered by the replay policy
+//
+// Usage: modcfg-bench [steps] [groups] [plugins] [patterns] [iterations]
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <libxml/parser.h>
+#include "modcfg.h"
+
+namespace {
+	std::string gen_module_config(const int n_steps, const int n_groups, const int n_plugins, const int n_patterns) {
+		const char		*types[] = { "SelectExactlyOne", "SelectAtMostOne", "SelectAny", "SelectAtLeastOne" };
+		std::ostringstream	x;
+		x << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<config>\n<moduleName>Bench Module</moduleName>\n";
+		x << "<requiredInstallFiles><folder source=\"Core\\Data\" destination=\"\"/></requiredInstallFiles>\n";
+		x << "<installSteps order=\"Explicit\">\n";
+		for(int s = 0; s < n_steps; ++s) {
+			x << "<installStep name=\"Step " << s << "\">\n";
+			if(s > 0)
+				x << "<visible><flagDependency flag=\"f" << (s-1) << "_0\" value=\"On\"/></visible>\n";
+			x << "<optionalFileGroups order=\"Explicit\">\n";
+			for(int g = 0; g < n_groups; ++g) {
+				x << "<group name=\"Group " << g << "\" type=\"" << types[g%4] << "\"><plugins order=\"Explicit\">\n";
+				for(int p = 0; p < n_plugins; ++p) {
+					x << "<plugin name=\"Plugin " << s << '.' << g << '.' << p << "\"><description>Generated</description>"
+					  << "<files><folder source=\"S" << s << "\\G" << g << "\\P" << p << "\\textures\" destination=\"textures\\s" << s << "\"/>"
+					  << "<file source=\"S" << s << "\\G" << g << "\\P" << p << "\\p.esp\" destination=\"p" << s << '_' << g << '_' << p << ".esp\"/></files>"
+					  << "<conditionFlags><flag name=\"f" << s << '_' << g << "\">" << ((p%2) ? "On" : "Off") << "</flag></conditionFlags>"
+					  << "<typeDescriptor>";
+					if(p%3)
+						x << "<type name=\"Optional\"/>";
+					else
+						x << "<dependencyType><defaultType name=\"Optional\"/><patterns><pattern><dependencies operator=\"Or\">"
+						  << "<flagDependency flag=\"f" << s << "_0\" value=\"On\"/><flagDependency flag=\"f0_0\"/></dependencies>"
+						  << "<type name=\"Recommended\"/></pattern></patterns></dependencyType>";
+					x << "</typeDescriptor></plugin>\n";
+				}
+				x << "</plugins></group>\n";
+			}
+			x << "</optionalFileGroups></installStep>\n";
+		}
+		x << "</installSteps>\n<conditionalFileInstalls><patterns>\n";
+		for(int p = 0; p < n_patterns; ++p) {
+			const int	s = p%n_steps;
+			x << "<pattern><dependencies operator=\"" << ((p%2) ? "Or" : "And") << "\">"
+			  << "<flagDependency flag=\"f" << s << '_' << (p%n_groups) << "\" value=\"On\"/>"
+			  << "<flagDependency flag=\"f" << s << "_0\"/></dependencies>"
+			  << "<files><file source=\"Patterns\\" << p << ".ini\" destination=\"" << p << ".ini\"/></files></pattern>\n";
+		}
+		x << "</patterns></conditionalFileInstalls>\n</config>\n";
+		return x.str();
+	}
+
+	double elapsed_ms(const std::chrono::steady_clock::time_point& start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		const int	n_steps = (argc > 1) ? std::atoi(argv[1]) : 50,
+				n_groups = (argc > 2) ? std::atoi(argv[2]) : 20,
+				n_plugins = (argc > 3) ? std::atoi(argv[3]) : 20,
+				n_patterns = (argc > 4) ? std::atoi(argv[4]) : 5000,
+				n_iter = (argc > 5) ? std::atoi(argv[5]) : 5;
+		if(n_steps <= 0 || n_groups <= 0 || n_plugins <= 0 || n_patterns < 0 || n_iter <= 0)
+			throw std::runtime_error("Invalid arguments");
+		const auto	xml = gen_module_config(n_steps, n_groups, n_plugins, n_patterns);
+		std::cout	<< "ModuleConfig: " << n_steps << " steps, " << n_groups << " groups/step, " << n_plugins << " plugins/group, "
+				<< n_patterns << " patterns (" << xml.size()/1024 << " KiB)" << std::endl;
+
+		answers::file		ans;
+		std::ostringstream	null_out;
+		std::istringstream	null_in;
+		double			t_compile = 0.0,
+					t_resolve = 0.0;
+		size_t			n_ops = 0;
+		for(int i = 0; i < n_iter; ++i) {
+			auto			start = std::chrono::steady_clock::now();
+			modcfg::parser		mcp(xml);
+			t_compile += elapsed_ms(start);
+			start = std::chrono::steady_clock::now();
+			const auto		ops = mcp.resolve(null_out, null_in, { "Data/", "", 0, &ans, true, 0 });
+			t_resolve += elapsed_ms(start);
+			n_ops = ops.size();
+			null_out.str("");
+		}
+		std::cout	<< "parse+compile\t" << t_compile/n_iter << " ms\n"
+				<< "resolve\t\t" << t_resolve/n_iter << " ms (" << n_ops << " ops selected)" << std::endl;
+		xmlCleanupParser();
+	} catch(const std::exception& e) {
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+}
+
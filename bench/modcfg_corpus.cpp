@@ -0,0 +1,139 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+// Harness running ModuleConfig.xml files of a corpus
+// directory (searched recursively, i.e. bench/corpus
+// or a set of extracted mods) through parsing and
+// evaluation only: no archive is opened and nothing
+// is extracted; answers come from the answers file
+// (replay policy for anything not answered). For each
+// file it prints timings and the resolved copy ops,
+// which can be diffed as regression baseline (use
+// --no-times to make the output stable)
+//
+// Usage: modcfg-corpus [--no-times] <corpus dir> [answers.xml] [iterations]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <libxml/parser.h>
+#include "modcfg.h"
+#include "utils.h"
+
+namespace {
+	double elapsed_ms(const std::chrono::steady_clock::time_point& start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void find_module_configs(const std::string& d_name, std::vector<std::string>& out) {
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(d_name.c_str()), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't open directory '") + d_name + "'");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get()))) {
+			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+				continue;
+			const std::string	f = d_name + '/' + de->d_name;
+			if(DT_DIR == de->d_type)
+				find_module_configs(f, out);
+			else if(utils::to_lower(de->d_name) == "moduleconfig.xml")
+				out.push_back(f);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		int		arg = 1;
+		const bool	no_times = (argc > 1) && !strcmp(argv[1], "--no-times");
+		if(no_times)
+			++arg;
+		if(argc <= arg)
+			throw std::runtime_error("Usage: modcfg-corpus [--no-times] <corpus dir> [answers.xml] [iterations]");
+		const std::string	corpus_dir = argv[arg],
+					ans_file = (argc > arg+1) ? argv[arg+1] : "";
+		const int		n_iter = (argc > arg+2) ? std::atoi(argv[arg+2]) : 1;
+		if(n_iter <= 0)
+			throw std::runtime_error("Invalid arguments");
+		answers::file		ans;
+		if(!ans_file.empty())
+			ans.load(ans_file);
+		std::vector<std::string>	files;
+		find_module_configs(corpus_dir, files);
+		std::sort(files.begin(), files.end());
+
+		std::ostringstream	null_out;
+		std::istringstream	null_in;
+		size_t			n_failed = 0;
+		double			t_tot_compile = 0.0,
+					t_tot_resolve = 0.0;
+		for(const auto& f : files) {
+			std::cout << f << '\n';
+			try {
+				std::ifstream		istr(f, std::ios_base::binary);
+				std::stringstream	sstr;
+				sstr << istr.rdbuf();
+				const auto		xml = sstr.str();
+				double			t_compile = 0.0,
+							t_resolve = 0.0;
+				std::unique_ptr<modcfg::parser>	mcp;
+				modcfg::parser::op_list		ops;
+				for(int i = 0; i < n_iter; ++i) {
+					auto	start = std::chrono::steady_clock::now();
+					mcp.reset(new modcfg::parser(xml));
+					t_compile += elapsed_ms(start);
+					start = std::chrono::steady_clock::now();
+					ops = mcp->resolve(null_out, null_in, { "Data/", "", 0, &ans, true, 0 });
+					t_resolve += elapsed_ms(start);
+					null_out.str("");
+				}
+				t_tot_compile += t_compile/n_iter;
+				t_tot_resolve += t_resolve/n_iter;
+				if(!no_times) {
+					std::cout	<< "\tparse+compile\t" << t_compile/n_iter << " ms\n"
+							<< "\tresolve\t\t" << t_resolve/n_iter << " ms\n";
+				}
+				std::cout << "\tmodule '" << mcp->ir().module_name << "', " << ops.size() << " ops\n";
+				for(const auto& o : ops) {
+					const auto&	c = mcp->ir().ops[o];
+					std::cout	<< '\t' << (c.is_folder ? "folder" : "file") << "\t[" << c.src << "] -> ["
+							<< c.dst << "] priority " << c.priority << '\n';
+				}
+			} catch(const std::exception& e) {
+				std::cout << "\terror: " << e.what() << '\n';
+				++n_failed;
+			}
+		}
+		std::cout << files.size() << " files, " << n_failed << " failed";
+		if(!no_times)
+			std::cout << ", parse+compile " << t_tot_compile << " ms, resolve " << t_tot_resolve << " ms";
+		std::cout << std::endl;
+		xmlCleanupParser();
+		return n_failed ? 1 : 0;
+	} catch(const std::exception& e) {
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+}
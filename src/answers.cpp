@@ -0,0 +1,163 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "answers.h"
+#include "utils.h"
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <libxml/xmlwriter.h>
+#include <memory>
+#include <fstream>
+
+#define ISO_ENCODING "ISO-8859-1"
+
+namespace {
+	typedef utils::XmlCharHolder	xc;
+
+	const std::string		N_ROOT("skyrim-pm-answers"),
+					N_MODULE("module"),
+					N_STEP("step"),
+					N_GROUP("group"),
+					N_PLUGIN("plugin"),
+					A_NAME("name");
+
+	struct xel_w {
+		xmlTextWriterPtr w;
+
+		xel_w(xmlTextWriterPtr w_, const std::string& n, const std::string& name) : w(w_) {
+			if(0 > xmlTextWriterStartElement(w, (const xmlChar*)n.c_str()))
+				throw std::runtime_error("Can't write answers file: xmlTextWriterStartElement");
+			if(0 > xmlTextWriterWriteAttribute(w, (const xmlChar*)A_NAME.c_str(), (const xmlChar*)name.c_str()))
+				throw std::runtime_error("Can't write answers file: xmlTextWriterWriteAttribute");
+		}
+
+		~xel_w() {
+			xmlTextWriterEndElement(w);
+		}
+	};
+
+	std::string get_name(xmlNode* n) {
+		const xc	nm(xmlGetProp(n, (const xmlChar*)A_NAME.c_str()));
+		if(!nm)
+			throw std::runtime_error(std::string("Invalid answers file, '") + (const char*)n->name + "' without 'name'");
+		return nm.c_str();
+	}
+
+	bool is_node(xmlNode* n, const std::string& name) {
+		return (n->type == XML_ELEMENT_NODE) && (name == (const char*)n->name);
+	}
+}
+
+const std::string	answers::file::REQ_STEP("<requiredInstallFiles>"),
+			answers::file::REQ_GROUP("<install>");
+
+void answers::file::load(const std::string& f, const bool must_exist) {
+	LOG << "Trying to load answers file '" << f << "'";
+	// check file exists first
+	{
+		std::ifstream	istr(f);
+		if(!istr) {
+			if(must_exist)
+				throw std::runtime_error(std::string("Can't open answers file '") + f + "'");
+			return;
+		}
+	}
+
+	std::unique_ptr<xmlDoc, void (*)(xmlDoc*)>	doc(xmlReadFile(f.c_str(), NULL, 0), xmlFreeDoc);
+	if(!doc)
+		throw std::runtime_error("Can't parse XML of answers file");
+	// structure of this XML is
+	// skyrim-pm-answers
+	// +-- module (name=...)
+	//     +-- step (name=...)
+	//         +-- group (name=...)
+	//             +-- plugin (name=...)
+	auto	re = xmlDocGetRootElement(doc.get());
+	if(N_ROOT != (const char*)re->name)
+		throw std::runtime_error("Invalid answers file");
+	for(auto m = re->children; m; m = m->next) {
+		if(!is_node(m, N_MODULE))
+			continue;
+		auto&	cur_m = m_[get_name(m)];
+		for(auto s = m->children; s; s = s->next) {
+			if(!is_node(s, N_STEP))
+				continue;
+			auto&	cur_s = cur_m[get_name(s)];
+			for(auto g = s->children; g; g = g->next) {
+				if(!is_node(g, N_GROUP))
+					continue;
+				auto&	cur_g = cur_s[get_name(g)];
+				cur_g.clear();
+				for(auto p = g->children; p; p = p->next) {
+					if(!is_node(p, N_PLUGIN))
+						continue;
+					cur_g.push_back(get_name(p));
+				}
+			}
+		}
+	}
+}
+
+void answers::file::save(const std::string& f) const {
+	LOG << "Writing answers file '" << f << "'";
+	std::unique_ptr<xmlDoc, void (*)(xmlDocPtr)>			dp(0, xmlFreeDoc);
+	xmlDocPtr							doc = 0;
+	std::unique_ptr<xmlTextWriter, void (*)(xmlTextWriterPtr)>	w(xmlNewTextWriterDoc(&doc, 0), xmlFreeTextWriter);
+	if(!w)
+		throw std::runtime_error("Can't initialize xml writer");
+	dp.reset(doc);
+	if(0 > xmlTextWriterStartDocument(w.get(), NULL, ISO_ENCODING, NULL))
+		throw std::runtime_error("Can't write answers file: xmlTextWriterStartDocument");
+	if(0 > xmlTextWriterStartElement(w.get(), (const xmlChar*)N_ROOT.c_str()))
+		throw std::runtime_error("Can't write answers file: xmlTextWriterStartElement");
+	for(const auto& m : m_) {
+		xel_w	module(w.get(), N_MODULE, m.first);
+		for(const auto& s : m.second) {
+			xel_w	step(w.get(), N_STEP, s.first);
+			for(const auto& g : s.second) {
+				xel_w	group(w.get(), N_GROUP, g.first);
+				for(const auto& p : g.second)
+					xel_w	plugin(w.get(), N_PLUGIN, p);
+			}
+		}
+	}
+	xmlTextWriterEndElement(w.get());
+	xmlTextWriterEndDocument(w.get());
+	utils::ensure_fname_path(f);
+	if(0 > xmlSaveFormatFileEnc(f.c_str(), dp.get(), ISO_ENCODING, 1))
+		throw std::runtime_error("Can't write answers file: xmlSaveFormatFileEnc");
+}
+
+bool answers::file::get(const std::string& module, const std::string& step, const std::string& group, choice& out) const {
+	const auto	m = m_.find(module);
+	if(m == m_.end())
+		return false;
+	const auto	s = m->second.find(step);
+	if(s == m->second.end())
+		return false;
+	const auto	g = s->second.find(group);
+	if(g == s->second.end())
+		return false;
+	out = g->second;
+	return true;
+}
+
+void answers::file::set(const std::string& module, const std::string& step, const std::string& group, const choice& c) {
+	m_[module][step][group] = c;
+}
+
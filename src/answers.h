@@ -0,0 +1,55 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _ANSWERS_H_
+#define _ANSWERS_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace answers {
+	typedef std::vector<std::string>	choice;
+
+	// FOMOD answers, keyed by module name, step
+	// name and group name; each answer is the list
+	// of names of the selected plugins so that it
+	// stays valid even if plugins get reordered
+	class file {
+		typedef std::map<std::string, choice>			groups;
+		typedef std::map<std::string, groups>			steps;
+		typedef std::map<std::string, steps>			modules;
+
+		modules	m_;
+public:
+		// reserved step/group names used to record the
+		// 'Required files - Install?' answer
+		static const std::string	REQ_STEP,
+						REQ_GROUP;
+
+		// a missing file is an empty set of answers,
+		// unless it has to exist (i.e. replaying)
+		void load(const std::string& f, const bool must_exist = false);
+		void save(const std::string& f) const;
+		bool get(const std::string& module, const std::string& step, const std::string& group, choice& out) const;
+		void set(const std::string& module, const std::string& step, const std::string& group, const choice& c);
+	};
+}
+
+#endif //_ANSWERS_H_
+
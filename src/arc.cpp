@@ -17,11 +17,15 @@
 
 #include "arc.h"
 #include "utils.h"
+#include "store.h"
 #include <fstream>
 #include <regex>
 #include <archive_entry.h>
 #include <strings.h>
 #include <unistd.h>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
 
 namespace {
 	size_t ci_find(const std::string& s, const std::string& f) {
@@ -33,9 +37,21 @@ namespace {
 		return std::string::npos;
 	}
 
-	void raw_extract_file(struct archive *a_, const std::string& p_name, const std::string& tgt_filename) {
-		utils::ensure_fname_path(tgt_filename);
-		std::ofstream		of(tgt_filename.c_str(), std::ios_base::binary);
+	void raw_extract_file(struct archive *a_, const std::string& p_name, const std::vector<std::string>& tgt_filenames, const std::string& store_dir, const std::string& store_new_dir) {
+		// the same entry may go to multiple targets,
+		// in such case the stream is read only once;
+		// with a store it's written there once and
+		// the targets are hard links to the blob
+		std::vector<std::unique_ptr<std::ofstream>>	ofs;
+		std::unique_ptr<store::writer>			sw;
+		if(!store_dir.empty()) {
+			sw.reset(new store::writer(store_new_dir));
+		} else {
+			for(const auto& t : tgt_filenames) {
+				utils::ensure_fname_path(t);
+				ofs.emplace_back(new std::ofstream(t.c_str(), std::ios_base::binary));
+			}
+		}
 		const static size_t	buflen = 2048;
 		char			buf[buflen];
 		la_ssize_t		rd = 0,
@@ -43,24 +59,40 @@ namespace {
 		while((rd = archive_read_data(a_, &buf[0], buflen)) >= 0){
 			if(0 == rd)
 				break;
-			of.write(&buf[0], rd);
+			for(auto& of : ofs)
+				of->write(&buf[0], rd);
+			if(sw)
+				sw->write(&buf[0], rd);
 			total_sz += rd;
 		}
 		if(rd < 0)
 			throw std::runtime_error((std::string("Corrupt stream, can't extract '") + p_name + "' from archive").c_str());
-		LOG << "File [" << p_name << "] extracted to [" << tgt_filename << "] (" << total_sz << ")";
+		if(sw) {
+			const auto	blob = sw->commit(store_dir, store_new_dir);
+			for(const auto& t : tgt_filenames) {
+				utils::ensure_fname_path(t);
+				remove(t.c_str());
+				if(link(blob.c_str(), t.c_str()))
+					throw std::runtime_error(std::string("Can't link store blob '") + blob + "' to '" + t + "' [" + std::to_string(errno) + "]");
+			}
+		}
+		for(const auto& t : tgt_filenames)
+			LOG << "File [" << p_name << "] extracted to [" << t << "] (" << total_sz << ")";
 	}
 
-	void add_symlink(const std::string& sym_filename, const std::string& tgt_filename) {
+	void add_link(const std::string& sym_filename, const std::string& tgt_filename, const utils::deploy_mode dm) {
+		// with fuse Data doesn't get touched
+		if(utils::deploy_mode::FUSE == dm)
+			return;
 		utils::ensure_fname_path(sym_filename);
-		if(symlink(tgt_filename.c_str(), sym_filename.c_str())) {
-			// if symlink already exists, remove and try again
+		if(utils::deploy_link(tgt_filename, sym_filename, dm)) {
+			// if link already exists, remove and try again
 			if(errno == EEXIST) {
 				remove(sym_filename.c_str());
-				if(symlink(tgt_filename.c_str(), sym_filename.c_str()))
-					throw std::runtime_error(std::string("symlink failed for '") + tgt_filename + "' --> '" + sym_filename + "' [" + std::to_string(errno) + "]");
+				if(utils::deploy_link(tgt_filename, sym_filename, dm))
+					throw std::runtime_error(std::string(utils::deploy_mode_name(dm)) + " failed for '" + tgt_filename + "' --> '" + sym_filename + "' [" + std::to_string(errno) + "]");
 			}
-			else throw std::runtime_error(std::string("symlink failed for '") + tgt_filename + "' --> '" + sym_filename + "' [" + std::to_string(errno) + "]");
+			else throw std::runtime_error(std::string(utils::deploy_mode_name(dm)) + " failed for '" + tgt_filename + "' --> '" + sym_filename + "' [" + std::to_string(errno) + "]");
 		}
 	}
 
@@ -77,7 +109,7 @@ namespace {
 
 	const sse_p_filetype get_file_type(const std::string& f_name) {
 		const static std::regex	bsa_regex("\\.bsa$" , std::regex_constants::ECMAScript | std::regex_constants::icase),
-					esp_regex("\\.esp$" , std::regex_constants::ECMAScript | std::regex_constants::icase),
+					esp_regex("\\.es[pml]$" , std::regex_constants::ECMAScript | std::regex_constants::icase),
 					ini_regex("\\.ini$" , std::regex_constants::ECMAScript | std::regex_constants::icase);
 		if(std::regex_search(f_name, bsa_regex)) {
 			return sse_p_filetype::BSA;
@@ -99,22 +131,58 @@ void arc::file::reset_archive(void) {
 	a_ = archive_read_new();
 	if(ARCHIVE_OK != archive_read_support_filter_all(a_)) {
 		archive_read_free(a_);
+		a_ = 0;
 		throw std::runtime_error("Can't initialize libarchive - archive_read_support_filter_all");
 	}
 	if(ARCHIVE_OK != archive_read_support_format_all(a_)) {
 		archive_read_free(a_);
+		a_ = 0;
 		throw std::runtime_error("Can't initialize libarchive - archive_read_support_format_all");
 	}
-	if(ARCHIVE_OK != archive_read_open_filename(a_, fname_.c_str(), 10240)) {
+	// the mapping is read in place (and seekable), if
+	// not available fall back to reading the file in
+	// large blocks
+	const int	rv = (mf_) ? archive_read_open_memory(a_, mf_->data(), mf_->size()) : archive_read_open_filename(a_, fname_.c_str(), 1024*1024);
+	if(ARCHIVE_OK != rv) {
 		archive_read_free(a_);
-		std::runtime_error((std::string("Can't open/read archive file '") + fname_ + "'").c_str()); 
+		a_ = 0;
+		throw std::runtime_error(std::string("Can't open/read archive file '") + fname_ + "'");
 	}
 }
 
-arc::file::file(const char* fname) : fname_(fname), a_(0) {
+std::string arc::file::staged(const std::string& p) const {
+	return stage_ ? stage_(p) : p;
+}
+
+std::string arc::file::link_target(const std::string& p) const {
+	// only symlinks can point to a
+	// file not yet in place
+	return (utils::deploy_mode::SYMLINK == dm_) ? p : staged(p);
+}
+
+arc::file::file(const char* fname) : fname_(fname), a_(0), dm_(utils::deploy_mode::SYMLINK) {
+	try {
+		mf_.reset(new utils::mmap_file(fname_));
+		mf_->prefetch();
+	} catch(const std::exception& e) {
+		LOG << "Archive '" << fname_ << "' not mapped (" << e.what() << "), reading it as a file";
+	}
 	reset_archive();
 }
 
+void arc::file::set_stage(const path_resolver& s) {
+	stage_ = s;
+}
+
+void arc::file::set_deploy_mode(const utils::deploy_mode dm) {
+	dm_ = dm;
+}
+
+void arc::file::set_store(const std::string& store_dir, const std::string& new_dir) {
+	store_dir_ = store_dir;
+	store_new_dir_ = new_dir;
+}
+
 std::vector<std::string> arc::file::list_content(void) {
 	std::vector<std::string>	out;
 	struct archive_entry	*entry = 0;
@@ -152,74 +220,99 @@ bool arc::file::extract_modcfg(std::ostream& data_out, const std::string& f_Modu
 	return rv;
 }
 
-bool arc::file::extract_file(const std::string& fname, const std::string& tgt_filename, const std::string& ov_filename, file_names* esp_list) {
-	LOG << "Extracting file [" << fname << "] as file [" << tgt_filename << "]";
-	if(!ov_filename.empty()) {
-		LOG << "\tOverride [" << ov_filename << "]";
-	}
-	bool			rv = false;
-	struct archive_entry	*entry = 0;
-	while(archive_read_next_header(a_, &entry) == ARCHIVE_OK) {
-		const std::string	p_name(archive_entry_pathname(entry));
-		size_t			pos = std::string::npos;
-		if((pos = ci_find(p_name, fname)) != std::string::npos) {
-			rv = true;
-			raw_extract_file(a_, p_name, ov_filename.empty() ? tgt_filename : ov_filename);
-			// if we need to report esp files
-			// and the file is and esp, then report it
-			if(esp_list && (sse_p_filetype::ESP == get_file_type(tgt_filename))) {
-				esp_list->push_back(tgt_filename);
-			}
-			if(!ov_filename.empty()) {
-				add_symlink(tgt_filename, ov_filename);
+arc::plan arc::file::plan_ops(const std::vector<copy_op>& ops) {
+	const auto	entries = list_content();
+	// winning op for each target, targets are
+	// keyed lowercase as Skyrim SE is not case
+	// sensitive
+	struct winner {
+		size_t		item,
+				op;
+	};
+	std::unordered_map<std::string, winner>	targets;
+	plan					rv;
+	auto fn_add = [&](const size_t op_idx, const std::string& entry, const std::string& target) -> void {
+		const auto	key = utils::to_lower(target);
+		auto		it = targets.find(key);
+		if(it == targets.end()) {
+			targets[key] = { rv.size(), op_idx };
+			rv.push_back({entry, target});
+			return;
+		}
+		// same priority, later op wins
+		if(ops[op_idx].priority < ops[it->second.op].priority)
+			return;
+		LOG << "Target [" << target << "] from [" << entry << "] replaces [" << rv[it->second.item].entry << "]";
+		rv[it->second.item] = {entry, target};
+		it->second.op = op_idx;
+	};
+	for(size_t i = 0; i < ops.size(); ++i) {
+		const auto&	o = ops[i];
+		bool		found = false;
+		for(const auto& p_name : entries) {
+			const size_t	pos = ci_find(p_name, o.src);
+			if(pos == std::string::npos)
+				continue;
+			if(!o.is_folder) {
+				fn_add(i, p_name, o.dst);
+				found = true;
+				break;
 			}
-			break;
+			// get the right hand side of the string
+			// rhs is to be lowercase Skyrim SE specs...
+			const std::string	rhs = utils::to_lower(p_name.substr(pos + o.src.length()));
+			if(rhs.empty() || (*rhs.rbegin() == '/'))
+				continue;
+			// and if rhs starts with '/' we shouldn't
+			// include it of course
+			fn_add(i, p_name, o.dst + ((*rhs.begin() == '/') ? rhs.substr(1) : rhs));
+			found = true;
+		}
+		if(!found) {
+			LOG << "Can't find [" << o.src << "] in archive";
 		}
 	}
-	// reset the archive handle
-	reset_archive();
+	LOG << "Resolved " << ops.size() << " ops into " << rv.size() << " targets";
 	return rv;
 }
 
-size_t arc::file::extract_dir(const std::string& base_match, const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list) {
-	LOG << "Extracting path [" << base_match << "] into directory [" << base_outdir << "]";
+size_t arc::file::extract_plan(const plan& p, const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list) {
 	if(!ov_base_dir.empty()) {
 		LOG << "\tOverride [" << ov_base_dir << "]";
 	}
-	size_t	rv = 0;
+	std::unordered_map<std::string, std::vector<const plan_item*>>	by_entry;
+	for(const auto& i : p)
+		by_entry[i.entry].push_back(&i);
+	size_t			rv = 0;
 	struct archive_entry	*entry = 0;
-	while(archive_read_next_header(a_, &entry) == ARCHIVE_OK) {
-		const std::string	p_name(archive_entry_pathname(entry));
-		size_t			pos = std::string::npos;
-		if((pos = ci_find(p_name, base_match)) != std::string::npos) {
-			// get the right hand side of the string
-			// rhs is to be lowercase Skyrim SE specs...
-			const std::string	rhs = utils::to_lower(p_name.substr(pos + base_match.length()));
-			if(rhs.empty() || (*rhs.rbegin() == '/'))
-				continue;
-			++rv;
-			// outdir should terminate with '/'
-			// and if rhs starts with '/' we shouldn't
-			// include it of course
-			const std::string	tgt_filename = base_outdir + ((*rhs.begin() == '/') ? rhs.substr(1) : rhs),
-						ovd_filename = ov_base_dir.empty() ? "" : (ov_base_dir + ((*rhs.begin() == '/') ? rhs.substr(1) : rhs));
-			raw_extract_file(a_, p_name, ovd_filename.empty() ? tgt_filename : ovd_filename);
+	while(!by_entry.empty() && archive_read_next_header(a_, &entry) == ARCHIVE_OK) {
+		const auto	it = by_entry.find(archive_entry_pathname(entry));
+		if(it == by_entry.end())
+			continue;
+		std::vector<std::string>	tgts;
+		for(const auto& i : it->second)
+			tgts.push_back(staged((ov_base_dir.empty() ? base_outdir : ov_base_dir) + i->target));
+		raw_extract_file(a_, it->first, tgts, ov_base_dir.empty() ? "" : store_dir_, store_new_dir_);
+		for(const auto& i : it->second) {
+			const std::string	tgt_filename = base_outdir + i->target;
 			// if we need to report esp files
 			// and the file is and esp, then report it
 			if(esp_list && (sse_p_filetype::ESP == get_file_type(tgt_filename))) {
 				esp_list->push_back(tgt_filename);
 			}
-			if(!ovd_filename.empty()) {
-				add_symlink(tgt_filename, ovd_filename);
+			if(!ov_base_dir.empty()) {
+				add_link(staged(tgt_filename), link_target(ov_base_dir + i->target), dm_);
 			}
+			++rv;
 		}
+		by_entry.erase(it);
 	}
 	// reset the archive handle
 	reset_archive();
 	return rv;
 }
 
-size_t arc::file::extract_data(const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list) {
+size_t arc::file::extract_data(const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list, const path_resolver& pr) {
 	if(!ov_base_dir.empty()) {
 		LOG << "\tOverride [" << ov_base_dir << "]";
 	}
@@ -241,26 +334,16 @@ size_t arc::file::extract_data(const std::string& base_outdir, const std::string
 			continue;
 		std::smatch		m;
 		sse_p_filetype		ft = sse_p_filetype::NONE;
-		std::string		tgt_filename,
-					sym_filename;
+		std::string		rel_filename;
 		if((ft = get_file_type(p_name)) != sse_p_filetype::NONE) {
 			++rv;
 			// get the filename and extract to base_outdir
 			// for now preserve original name casing
 			const auto		p_slash = p_name.find_last_of('/');
-			tgt_filename = act_base_outdir + ((p_slash != std::string::npos) ? p_name.substr(p_slash+1) : p_name);
-			sym_filename = (ov_base_dir.empty()) ? "" : base_outdir + ((p_slash != std::string::npos) ? p_name.substr(p_slash+1) : p_name);
-			raw_extract_file(a_, p_name, tgt_filename);
-			// in case we have loaded an esp
-			// then add it to the list
-			if(esp_list && (ft == sse_p_filetype::ESP)) {
-				esp_list->push_back(tgt_filename);
-			}
+			rel_filename = (p_slash != std::string::npos) ? p_name.substr(p_slash+1) : p_name;
 		} else if(std::regex_search(p_name, m, data_regex)) {
 			// extract path and make it lowercase
-			tgt_filename = act_base_outdir + utils::to_lower(p_name.substr(m.position() + m.length()));
-			sym_filename = (ov_base_dir.empty()) ? "" : base_outdir + utils::to_lower(p_name.substr(m.position() + m.length()));
-			raw_extract_file(a_, p_name, tgt_filename);
+			rel_filename = utils::to_lower(p_name.substr(m.position() + m.length()));
 		} else if(std::regex_search(p_name, m, meshes_regex) ||
 			  std::regex_search(p_name, m, textures_regex) ||
 			  std::regex_search(p_name, m, sound_regex) ||
@@ -269,14 +352,24 @@ size_t arc::file::extract_data(const std::string& base_outdir, const std::string
 			// ensure if the first term of match is '/'
 			// to exclude it
 			const size_t		slash_shift = (*(m[0].str().begin()) == '/') ? 1 : 0;
-			tgt_filename = act_base_outdir + utils::to_lower(p_name.substr(m.position() + slash_shift));
-			sym_filename = (ov_base_dir.empty()) ? "" : base_outdir + utils::to_lower(p_name.substr(m.position() + slash_shift));
-			raw_extract_file(a_, p_name, tgt_filename);
+			rel_filename = utils::to_lower(p_name.substr(m.position() + slash_shift));
 		} else {
 			LOG << "Unprocessed file [" << p_name << "]";
+			continue;
+		}
+		// reuse the casing of what's already there
+		if(pr)
+			rel_filename = pr(rel_filename);
+		const std::string	tgt_filename = act_base_outdir + rel_filename,
+					sym_filename = (ov_base_dir.empty()) ? "" : base_outdir + rel_filename;
+		raw_extract_file(a_, p_name, std::vector<std::string>(1, staged(tgt_filename)), ov_base_dir.empty() ? "" : store_dir_, store_new_dir_);
+		// in case we have loaded an esp
+		// then add it to the list
+		if(esp_list && (ft == sse_p_filetype::ESP)) {
+			esp_list->push_back(sym_filename.empty() ? tgt_filename : sym_filename);
 		}
 		if(!sym_filename.empty()) {
-			add_symlink(sym_filename, tgt_filename);
+			add_link(staged(sym_filename), link_target(tgt_filename), dm_);
 		}
 	}
 	return rv;
@@ -21,22 +21,72 @@
 #include <archive.h>
 #include <vector>
 #include <string>
+#include <functional>
+#include <memory>
+#include "utils.h"
 
 namespace arc {
 	typedef std::vector<std::string>	file_names;
+	// maps a path relative to Data to the
+	// one to be actually written
+	typedef std::function<std::string(const std::string&)>	path_resolver;
+
+	// copy operation of a file or a folder from
+	// the archive, 'dst' is relative to Data
+	// (and '/' terminated for folders)
+	struct copy_op {
+		bool		is_folder;
+		std::string	src,
+				dst;
+		int		priority;
+	};
+
+	// single archive entry to be extracted to
+	// 'target', relative to Data
+	struct plan_item {
+		std::string	entry,
+				target;
+	};
+
+	typedef std::vector<plan_item>	plan;
 
 	class file {
-		const std::string	fname_;
-		struct archive		*a_;
+		const std::string			fname_;
+		// mapped once, each pass over the
+		// archive reads it from memory
+		std::unique_ptr<utils::mmap_file>	mf_;
+		struct archive				*a_;
+		path_resolver		stage_;
+		utils::deploy_mode	dm_;
+		std::string		store_dir_,
+					store_new_dir_;
 
 		void reset_archive(void);
+		std::string staged(const std::string& p) const;
+		std::string link_target(const std::string& p) const;
 public:
 		file(const char* fname);
+		// when set, files and symlinks get written to
+		// the paths mapped by 's', while symlink targets
+		// and the reported esp files keep the final ones
+		void set_stage(const path_resolver& s);
+		// how the override files get deployed into
+		// Data, symlinks by default
+		void set_deploy_mode(const utils::deploy_mode dm);
+		// when set, the override files get saved once
+		// per content in store_dir (new blobs in new_dir)
+		// and hard linked to their paths, see store.h
+		void set_store(const std::string& store_dir, const std::string& new_dir);
 		std::vector<std::string> list_content(void);
 		bool extract_modcfg(std::ostream& data_out, const std::string& f_ModuleConfig = "ModuleConfig.xml");
-		bool extract_file(const std::string& fname, const std::string& tgt_filename, const std::string& ov_filename, file_names* esp_list);
-		size_t extract_dir(const std::string& base_match, const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list);
-		size_t extract_data(const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list);
+		// resolves all the ops into one target per path,
+		// the op with higher priority and then the later
+		// one in the list winning; ops are expanded against
+		// the archive content
+		plan plan_ops(const std::vector<copy_op>& ops);
+		// extracts all the plan items in a single pass
+		size_t extract_plan(const plan& p, const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list);
+		size_t extract_data(const std::string& base_outdir, const std::string& ov_base_dir, file_names* esp_list, const path_resolver& pr = path_resolver());
 		~file();
 	};
 }
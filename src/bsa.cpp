@@ -0,0 +1,323 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "bsa.h"
+#include "utils.h"
+#include <lz4frame.h>
+#include <cstring>
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <map>
+
+namespace {
+	// archives are little endian
+	uint32_t rd_u32(const uint8_t* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	enum archive_flags {
+		A_DIR_NAMES = 0x1,
+		A_FILE_NAMES = 0x2
+	};
+
+	// header is magic, version, offset, archive flags,
+	// folder count, file count, total folder names
+	// length, total file names length and file flags;
+	// folder records are hash, count and offset (with
+	// some padding and 64 bits offset on v105)
+	const size_t	HDR_SZ = 36,
+			FOLDER_REC_SZ_104 = 16,
+			FOLDER_REC_SZ_105 = 24,
+			FILE_REC_SZ = 16;
+
+	enum archive_flags_w {
+		F_MESHES = 0x1,
+		F_TEXTURES = 0x2,
+		F_MENUS = 0x4,
+		F_SOUNDS = 0x8
+	};
+
+	// size bit flipping the default compression
+	const uint32_t	SIZE_COMPRESS_TOGGLE = 0x40000000;
+	// the game can't address more than this
+	const uint64_t	MAX_BSA_SZ = 0x7FFFFFFF;
+	// max raw size compressed in memory at once
+	const uint64_t	MAX_BATCH_SZ = 256*1024*1024;
+
+	void wr_u16(std::string& out, const uint16_t v) {
+		out += (char)(v & 0xFF);
+		out += (char)(v >> 8);
+	}
+
+	void wr_u32(std::string& out, const uint32_t v) {
+		wr_u16(out, v & 0xFFFF);
+		wr_u16(out, v >> 16);
+	}
+
+	void wr_u64(std::string& out, const uint64_t v) {
+		wr_u32(out, v & 0xFFFFFFFF);
+		wr_u32(out, v >> 32);
+	}
+
+	// hash used by the game to look up folders
+	// and files, names are lowercase with '\\'
+	uint64_t tes_hash(const std::string& name, const std::string& ext) {
+		const size_t	len = name.length();
+		const uint8_t	*n = (const uint8_t*)name.c_str();
+		uint32_t	h1 = (len ? n[len-1] : 0) |
+				     ((len > 2 ? n[len-2] : 0) << 8) |
+				     ((len & 0xFF) << 16) |
+				     ((uint32_t)(len ? n[0] : 0) << 24);
+		if(ext == ".kf") h1 |= 0x80;
+		else if(ext == ".nif") h1 |= 0x8000;
+		else if(ext == ".dds") h1 |= 0x8080;
+		else if(ext == ".wav") h1 |= 0x80000000;
+		uint32_t	h2 = 0,
+				h3 = 0;
+		for(size_t i = 1; i + 2 < len; ++i)
+			h2 = h2*0x1003F + n[i];
+		for(const auto& c : ext)
+			h3 = h3*0x1003F + (uint8_t)c;
+		return (((uint64_t)(h2 + h3)) << 32) | h1;
+	}
+
+	uint64_t file_hash(const std::string& f) {
+		const auto	p_dot = f.find_last_of('.');
+		if(p_dot == std::string::npos)
+			return tes_hash(f, "");
+		return tes_hash(f.substr(0, p_dot), f.substr(p_dot));
+	}
+
+	uint32_t content_flag(const std::string& asset) {
+		if(!asset.compare(0, 7, "meshes/")) return F_MESHES;
+		if(!asset.compare(0, 9, "textures/")) return F_TEXTURES;
+		if(!asset.compare(0, 10, "interface/")) return F_MENUS;
+		if(!asset.compare(0, 6, "sound/")) return F_SOUNDS;
+		return 0;
+	}
+
+	std::string to_asset_path(const char* p, const size_t len) {
+		std::string	rv(p, strnlen(p, len));
+		for(auto& c : rv) {
+			if(c == '\\')
+				c = '/';
+		}
+		return utils::to_lower(rv);
+	}
+}
+
+void bsa::list(const std::string& f_name, std::vector<std::string>& out) {
+	const utils::mmap_file	mf(f_name);
+	const uint8_t		*p = mf.data(),
+				*end = p + mf.size();
+	if(mf.size() < HDR_SZ || std::memcmp(p, "BSA\0", 4))
+		throw std::runtime_error(std::string("File '") + f_name + "' is not a BSA");
+	const uint32_t	version = rd_u32(p + 4),
+			offset = rd_u32(p + 8),
+			a_flags = rd_u32(p + 12),
+			n_folders = rd_u32(p + 16),
+			n_files = rd_u32(p + 20),
+			file_names_len = rd_u32(p + 28);
+	if(version != 104 && version != 105)
+		throw std::runtime_error(std::string("BSA '") + f_name + "' has unsupported version " + std::to_string(version));
+	if(!(a_flags & A_DIR_NAMES) || !(a_flags & A_FILE_NAMES))
+		throw std::runtime_error(std::string("BSA '") + f_name + "' doesn't store folder and file names");
+	const size_t	folder_rec_sz = (version == 105) ? FOLDER_REC_SZ_105 : FOLDER_REC_SZ_104;
+	const uint8_t	*folders = p + offset,
+			*cur = folders + (size_t)n_folders*folder_rec_sz;
+	if(cur > end)
+		throw std::runtime_error(std::string("BSA '") + f_name + "' has truncated folder records");
+	// the file names block comes right after all
+	// the file record blocks, and follows their order
+	const uint8_t	*f_names = cur;
+	for(uint32_t i = 0; i < n_folders; ++i) {
+		if(f_names >= end)
+			throw std::runtime_error(std::string("BSA '") + f_name + "' has truncated file records");
+		f_names += 1 + *f_names + (size_t)rd_u32(folders + i*folder_rec_sz + 8)*FILE_REC_SZ;
+	}
+	if(f_names + file_names_len > end)
+		throw std::runtime_error(std::string("BSA '") + f_name + "' has truncated file names");
+	const uint8_t	*f_names_end = f_names + file_names_len;
+	out.reserve(out.size() + n_files);
+	for(uint32_t i = 0; i < n_folders; ++i) {
+		const uint32_t	n_folder_files = rd_u32(folders + i*folder_rec_sz + 8);
+		// folder name is a length prefixed, zero
+		// terminated string; root files have none
+		std::string	folder = to_asset_path((const char*)cur + 1, *cur);
+		if(folder == ".")
+			folder.clear();
+		if(!folder.empty())
+			folder += '/';
+		cur += 1 + *cur + (size_t)n_folder_files*FILE_REC_SZ;
+		for(uint32_t j = 0; j < n_folder_files; ++j) {
+			if(f_names >= f_names_end)
+				throw std::runtime_error(std::string("BSA '") + f_name + "' has fewer file names than files");
+			const size_t	len = strnlen((const char*)f_names, f_names_end - f_names);
+			out.push_back(folder + to_asset_path((const char*)f_names, len));
+			f_names += len + 1;
+		}
+	}
+}
+
+void bsa::pack(const std::string& f_name, const std::vector<pack_item>& items) {
+	// group files by folder, the game looks both
+	// folders and files up by hash, hence those
+	// have to be sorted by it
+	struct file_rec {
+		uint64_t	hash;
+		std::string	name;
+		const pack_item	*item;
+		uint32_t	size,
+				offset;
+	};
+	struct folder_rec {
+		std::string		name;
+		std::vector<file_rec>	files;
+	};
+	std::map<uint64_t, folder_rec>	folders;
+	uint32_t			c_flags = 0;
+	size_t				folder_names_len = 0,
+					file_names_len = 0;
+	for(const auto& i : items) {
+		std::string	asset = utils::to_lower(i.asset);
+		c_flags |= content_flag(asset);
+		std::replace(asset.begin(), asset.end(), '/', '\\');
+		const auto	p_slash = asset.find_last_of('\\');
+		if(p_slash == std::string::npos)
+			throw std::runtime_error(std::string("Can't pack asset '") + i.asset + "' outside of a folder");
+		const auto	dir = asset.substr(0, p_slash);
+		auto&		f = folders[tes_hash(dir, "")];
+		if(dir.length() > 254)
+			throw std::runtime_error(std::string("Can't pack folder '") + dir + "', name too long");
+		if(f.name.empty()) {
+			f.name = dir;
+			folder_names_len += dir.length() + 1;
+		} else if(f.name != dir)
+			throw std::runtime_error(std::string("Folder hash collision packing '") + dir + "' and '" + f.name + "'");
+		f.files.push_back({file_hash(asset.substr(p_slash+1)), asset.substr(p_slash+1), &i, 0, 0});
+		file_names_len += f.files.back().name.length() + 1;
+	}
+	std::vector<file_rec*>	order;
+	for(auto& f : folders) {
+		std::sort(f.second.files.begin(), f.second.files.end(), [](const file_rec& lhs, const file_rec& rhs) {
+			return lhs.hash < rhs.hash;
+		});
+		for(size_t i = 0; i < f.second.files.size(); ++i) {
+			if(i && f.second.files[i].hash == f.second.files[i-1].hash)
+				throw std::runtime_error(std::string("File hash collision packing '") + f.second.files[i].name + "' and '" + f.second.files[i-1].name + "'");
+			order.push_back(&f.second.files[i]);
+		}
+	}
+	// file data starts right after header, folder
+	// records, file record blocks and file names
+	const size_t	records_sz = HDR_SZ + folders.size()*FOLDER_REC_SZ_105,
+			data_start = records_sz + (folders.size() + folder_names_len) + order.size()*FILE_REC_SZ + file_names_len;
+	std::ofstream	ostr(f_name, std::ios_base::binary|std::ios_base::trunc);
+	if(!ostr)
+		throw std::runtime_error(std::string("Can't open BSA '") + f_name + "' for writing");
+	ostr.seekp(data_start);
+	// compress in parallel a batch of files at
+	// a time, then write them in order
+	uint64_t	cur_offset = data_start;
+	for(size_t b_begin = 0; b_begin < order.size(); ) {
+		size_t		b_end = b_begin;
+		uint64_t	b_sz = 0;
+		while(b_end < order.size() && (b_end == b_begin || b_sz < MAX_BATCH_SZ)) {
+			std::ifstream	istr(order[b_end]->item->src, std::ios_base::binary|std::ios_base::ate);
+			b_sz += istr ? (uint64_t)istr.tellg() : 0;
+			++b_end;
+		}
+		std::vector<std::string>	data(b_end - b_begin);
+		std::vector<char>		compressed(b_end - b_begin, 0);
+		utils::parallel_for(b_end - b_begin, [&](const size_t i) {
+			const file_rec&		fr = *order[b_begin + i];
+			const utils::mmap_file	mf(fr.item->src);
+			std::string&		out = data[i];
+			if(content_flag(utils::to_lower(fr.item->asset)) != F_SOUNDS) {
+				// compressed data is prefixed by the
+				// original size, and is an LZ4 frame
+				const size_t	bound = LZ4F_compressFrameBound(mf.size(), 0);
+				out.resize(4 + bound);
+				const size_t	c_sz = LZ4F_compressFrame(&out[4], bound, mf.data(), mf.size(), 0);
+				if(LZ4F_isError(c_sz))
+					throw std::runtime_error(std::string("Can't compress '") + fr.item->src + "': " + LZ4F_getErrorName(c_sz));
+				if(4 + c_sz < mf.size()) {
+					out.resize(4 + c_sz);
+					out[0] = mf.size() & 0xFF;
+					out[1] = (mf.size() >> 8) & 0xFF;
+					out[2] = (mf.size() >> 16) & 0xFF;
+					out[3] = (mf.size() >> 24) & 0xFF;
+					compressed[i] = 1;
+					return;
+				}
+			}
+			out.assign((const char*)mf.data(), mf.size());
+		}, 1);
+		for(size_t i = 0; i < data.size(); ++i) {
+			file_rec&	fr = *order[b_begin + i];
+			if(cur_offset + data[i].size() > MAX_BSA_SZ)
+				throw std::runtime_error(std::string("BSA '") + f_name + "' would exceed 2GB");
+			fr.offset = cur_offset;
+			fr.size = data[i].size() | (compressed[i] ? SIZE_COMPRESS_TOGGLE : 0);
+			cur_offset += data[i].size();
+			ostr.write(data[i].c_str(), data[i].size());
+		}
+		b_begin = b_end;
+	}
+	// now header, folders and files records
+	std::string	hdr;
+	hdr.append("BSA\0", 4);
+	wr_u32(hdr, 105);
+	wr_u32(hdr, HDR_SZ);
+	wr_u32(hdr, A_DIR_NAMES|A_FILE_NAMES);
+	wr_u32(hdr, folders.size());
+	wr_u32(hdr, order.size());
+	wr_u32(hdr, folder_names_len);
+	wr_u32(hdr, file_names_len);
+	wr_u16(hdr, c_flags);
+	wr_u16(hdr, 0);
+	// folder offsets point to the file record
+	// block, plus the total file names length
+	std::string	blocks,
+			names;
+	for(const auto& f : folders) {
+		wr_u64(hdr, f.first);
+		wr_u32(hdr, f.second.files.size());
+		wr_u32(hdr, 0);
+		wr_u64(hdr, records_sz + blocks.size() + file_names_len);
+		blocks += (char)(f.second.name.length() + 1);
+		blocks += f.second.name;
+		blocks += '\0';
+		for(const auto& i : f.second.files) {
+			wr_u64(blocks, i.hash);
+			wr_u32(blocks, i.size);
+			wr_u32(blocks, i.offset);
+			names += i.name;
+			names += '\0';
+		}
+	}
+	ostr.seekp(0);
+	ostr.write(hdr.c_str(), hdr.size());
+	ostr.write(blocks.c_str(), blocks.size());
+	ostr.write(names.c_str(), names.size());
+	ostr.flush();
+	if(!ostr)
+		throw std::runtime_error(std::string("Can't write BSA '") + f_name + "'");
+	LOG << "BSA '" << f_name << "' written with " << order.size() << " files in " << folders.size() << " folders";
+}
@@ -0,0 +1,46 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _BSA_H_
+#define _BSA_H_
+
+#include <string>
+#include <vector>
+
+namespace bsa {
+	// appends to out all the asset paths (lowercase and
+	// '/' separated, relative to Data) stored in BSA
+	// f_name; only the folder/file tables get read.
+	// Supports v104 (LE) and v105 (SE) archives with
+	// folder and file names, throws otherwise
+	extern void list(const std::string& f_name, std::vector<std::string>& out);
+
+	// a file to be packed: asset is its path
+	// relative to Data, src the real (non empty) file
+	struct pack_item {
+		std::string	asset,
+				src;
+	};
+
+	// writes a v105 (SE) BSA f_name with all the items;
+	// files are LZ4 compressed in parallel, but for the
+	// sounds which the game wants uncompressed
+	extern void pack(const std::string& f_name, const std::vector<pack_item>& items);
+}
+
+#endif //_BSA_H_
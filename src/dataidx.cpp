@@ -0,0 +1,154 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "dataidx.h"
+#include "utils.h"
+#include <dirent.h>
+#include <cstring>
+#include <memory>
+#include <fstream>
+#include <regex>
+
+namespace {
+	void rec_dir_scan(const std::string& d_name, const std::string& rel, std::unordered_map<std::string, std::string>& out) {
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(d_name.c_str()), closedir);
+		if(!d)
+			return;
+		struct dirent	*de = 0;
+		while((de = readdir(d.get()))) {
+			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+				continue;
+			const std::string	cur_rel = rel + de->d_name;
+			// in case of names differing only by case
+			// the first one found is kept
+			out.insert(std::make_pair(utils::to_lower(cur_rel), cur_rel));
+			if(DT_DIR == de->d_type)
+				rec_dir_scan(d_name + de->d_name + '/', cur_rel + '/', out);
+		}
+	}
+
+	bool is_plugin(const std::string& f) {
+		const static std::regex	plugin_regex("\\.es[pml]$" , std::regex_constants::ECMAScript | std::regex_constants::icase);
+		return std::regex_search(f, plugin_regex);
+	}
+
+	// masters of the base game are always active
+	// and never listed in Plugins.txt
+	bool is_base_master(const std::string& f) {
+		return	f == "skyrim.esm" || f == "update.esm" || f == "dawnguard.esm" ||
+			f == "hearthfires.esm" || f == "dragonborn.esm";
+	}
+}
+
+void dataidx::index::load_data(void) {
+	if(data_loaded_)
+		return;
+	rec_dir_scan(data_dir_, "", files_);
+	data_loaded_ = true;
+	LOG << "Data index built with " << files_.size() << " entries";
+}
+
+void dataidx::index::load_plugins(void) {
+	if(plugins_loaded_)
+		return;
+	plugins_loaded_ = true;
+	if(plugins_file_.empty())
+		return;
+	std::ifstream	istr(plugins_file_);
+	std::string	line;
+	while(std::getline(istr, line)) {
+		line = utils::trim(line);
+		// enabled plugins are marked with a '*'
+		if(line.length() < 2 || line[0] != '*')
+			continue;
+		active_.insert(utils::to_lower(line.substr(1)));
+	}
+	LOG << "Plugins index built with " << active_.size() << " enabled plugins";
+}
+
+dataidx::index::index(const std::string& data_dir, const std::string& plugins_file) : data_dir_(data_dir), plugins_file_(plugins_file), data_loaded_(false), plugins_loaded_(false) {
+}
+
+dataidx::index::file_state dataidx::index::state(const std::string& f) {
+	load_data();
+	const auto	lf = utils::to_lower(utils::path2unix(f));
+	if(files_.find(lf) == files_.end())
+		return file_state::MISSING;
+	// only plugins can be inactive, and if we don't
+	// know about Plugins.txt assume those are active
+	if(!is_plugin(lf) || plugins_file_.empty() || is_base_master(lf))
+		return file_state::ACTIVE;
+	load_plugins();
+	return (active_.find(lf) != active_.end()) ? file_state::ACTIVE : file_state::INACTIVE;
+}
+
+std::string dataidx::index::cased(const std::string& f) {
+	load_data();
+	const auto	uf = utils::path2unix(f),
+			lf = utils::to_lower(uf);
+	// most of the times the whole path is there
+	const auto	it_f = files_.find(lf);
+	if(it_f != files_.end())
+		return it_f->second;
+	// otherwise resolve one directory at a time,
+	// each step being a lookup of the full prefix
+	std::string	rv;
+	size_t		p_begin = 0;
+	while(true) {
+		const auto	p_slash = lf.find('/', p_begin);
+		const auto	key = lf.substr(0, p_slash);
+		auto		it = files_.find(key);
+		if(it == files_.end())
+			it = files_.insert(std::make_pair(key, (p_begin ? rv + '/' : "") + uf.substr(p_begin, p_slash - p_begin))).first;
+		rv = it->second;
+		if(p_slash == std::string::npos)
+			break;
+		p_begin = p_slash + 1;
+	}
+	return rv;
+}
+
+void dataidx::index::add_file(const std::string& f) {
+	if(!data_loaded_)
+		return;
+	// add all the parent directories as well
+	const auto	uf = utils::path2unix(f),
+			lf = utils::to_lower(uf);
+	for(auto p_slash = lf.find('/'); p_slash != std::string::npos; p_slash = lf.find('/', p_slash+1))
+		files_.insert(std::make_pair(lf.substr(0, p_slash), uf.substr(0, p_slash)));
+	files_.insert(std::make_pair(lf, uf));
+}
+
+void dataidx::index::set_active(const std::string& plugin) {
+	if(!plugins_loaded_)
+		return;
+	active_.insert(utils::to_lower(plugin));
+}
+
+void dataidx::index::load(void) {
+	load_data();
+	load_plugins();
+}
+
+const std::string& dataidx::index::data_dir(void) const {
+	return data_dir_;
+}
+
+const std::string& dataidx::index::plugins_file(void) const {
+	return plugins_file_;
+}
@@ -0,0 +1,69 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _DATAIDX_H_
+#define _DATAIDX_H_
+
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+
+namespace dataidx {
+	// case-insensitive index of the content of Data
+	// (lowercase path to the casing on disk) and of
+	// the enabled plugins in Plugins.txt; each one
+	// gets built once, at first query, and is kept
+	// updated with what gets installed during the run
+	class index {
+		const std::string				data_dir_,
+								plugins_file_;
+		bool						data_loaded_,
+								plugins_loaded_;
+		std::unordered_map<std::string, std::string>	files_;
+		std::unordered_set<std::string>			active_;
+
+		void load_data(void);
+		void load_plugins(void);
+public:
+		enum file_state {
+			MISSING = 0,
+			INACTIVE,
+			ACTIVE
+		};
+
+		// data_dir has to be '/' terminated, plugins_file
+		// can be empty if unknown
+		index(const std::string& data_dir, const std::string& plugins_file);
+		// f is relative to Data
+		file_state state(const std::string& f);
+		// returns f with the casing already used on
+		// disk for its existing part (directories or
+		// the file itself); the rest is kept as is and
+		// recorded, as it's going to be created
+		std::string cased(const std::string& f);
+		void add_file(const std::string& f);
+		void set_active(const std::string& plugin);
+		// builds both indexes upfront
+		void load(void);
+		const std::string& data_dir(void) const;
+		const std::string& plugins_file(void) const;
+	};
+}
+
+#endif //_DATAIDX_H_
+
@@ -0,0 +1,210 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "esp.h"
+#include "utils.h"
+#include <dirent.h>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <stdexcept>
+#include <fstream>
+
+namespace {
+	// plugins are little endian
+	uint16_t rd_u16(const uint8_t* p) {
+		return p[0] | (p[1] << 8);
+	}
+
+	uint32_t rd_u32(const uint8_t* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	// record header is type, size, flags, form id,
+	// version control info, version and unknown;
+	// sub-record header is type and size
+	const size_t	REC_HDR_SZ = 24,
+			SUBREC_HDR_SZ = 6;
+
+	void wr_u16(std::string& out, const uint16_t v) {
+		out += (char)(v & 0xFF);
+		out += (char)(v >> 8);
+	}
+
+	void wr_u32(std::string& out, const uint32_t v) {
+		wr_u16(out, v & 0xFFFF);
+		wr_u16(out, v >> 16);
+	}
+
+	void wr_subrec(std::string& out, const char* type, const std::string& data) {
+		out.append(type, 4);
+		wr_u16(out, data.size());
+		out += data;
+	}
+
+	bool is_master_ext(const std::string& f) {
+		const auto	l = utils::to_lower(f);
+		return	l.length() > 4 &&
+			(0 == l.compare(l.length()-4, 4, ".esm") || 0 == l.compare(l.length()-4, 4, ".esl"));
+	}
+}
+
+esp::header esp::read_header(const std::string& f_name) {
+	const utils::mmap_file	mf(f_name);
+	const uint8_t		*p = mf.data();
+	if(mf.size() < REC_HDR_SZ || std::memcmp(p, "TES4", 4))
+		throw std::runtime_error(std::string("File '") + f_name + "' doesn't start with a TES4 record");
+	const size_t	rec_sz = rd_u32(p + 4);
+	if(REC_HDR_SZ + rec_sz > mf.size())
+		throw std::runtime_error(std::string("File '") + f_name + "' has a truncated TES4 record");
+	header		rv;
+	rv.flags = rd_u32(p + 8);
+	// walk the sub-records, XXXX carries the size
+	// of the following one when it exceeds 64k
+	const uint8_t	*cur = p + REC_HDR_SZ,
+			*end = cur + rec_sz;
+	size_t		next_sz = 0;
+	while(cur + SUBREC_HDR_SZ <= end) {
+		size_t	sz = rd_u16(cur + 4);
+		if(next_sz) {
+			sz = next_sz;
+			next_sz = 0;
+		}
+		const uint8_t	*data = cur + SUBREC_HDR_SZ;
+		if(data + sz > end)
+			throw std::runtime_error(std::string("File '") + f_name + "' has a truncated TES4 sub-record");
+		if(!std::memcmp(cur, "XXXX", 4) && sz == 4) {
+			next_sz = rd_u32(data);
+		} else if(!std::memcmp(cur, "MAST", 4) && sz) {
+			// zero terminated string
+			rv.masters.push_back(std::string((const char*)data, strnlen((const char*)data, sz)));
+		}
+		cur = data + sz;
+	}
+	rv.valid = true;
+	return rv;
+}
+
+void esp::write_dummy(const std::string& f_name) {
+	// HEDR is version (1.7 as float), number
+	// of records and next object id
+	std::string	hedr,
+			subrecs;
+	wr_u32(hedr, 0x3FD9999A);
+	wr_u32(hedr, 0);
+	wr_u32(hedr, 0x800);
+	wr_subrec(subrecs, "HEDR", hedr);
+	wr_subrec(subrecs, "CNAM", std::string("skyrim-pm", 10));
+	wr_subrec(subrecs, "MAST", std::string("Skyrim.esm", 11));
+	wr_subrec(subrecs, "DATA", std::string(8, '\0'));
+	std::string	rec("TES4");
+	wr_u32(rec, subrecs.size());
+	wr_u32(rec, F_LIGHT);
+	wr_u32(rec, 0);
+	wr_u32(rec, 0);
+	// SE form version
+	wr_u16(rec, 44);
+	wr_u16(rec, 0);
+	rec += subrecs;
+	std::ofstream	ostr(f_name, std::ios_base::binary|std::ios_base::trunc);
+	ostr.write(rec.c_str(), rec.size());
+	ostr.flush();
+	if(!ostr)
+		throw std::runtime_error(std::string("Can't write plugin '") + f_name + "'");
+}
+
+std::vector<esp::header> esp::scan(const std::string& data_dir, const std::vector<std::string>& plugins) {
+	// Plugins.txt casing may not match the files,
+	// hence list Data once to find the real names
+	std::unordered_map<std::string, std::string>	names;
+	{
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(data_dir.c_str()), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't open Data directory '") + data_dir + "'");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get())))
+			names[utils::to_lower(de->d_name)] = de->d_name;
+	}
+	std::vector<header>	rv(plugins.size());
+	utils::parallel_for(plugins.size(), [&](const size_t i) {
+		const auto	it = names.find(utils::to_lower(plugins[i]));
+		if(it == names.end())
+			return;
+		try {
+			rv[i] = read_header(data_dir + it->second);
+		} catch(const std::exception& e) {
+			LOG << "Can't read header of plugin '" << plugins[i] << "': " << e.what();
+		}
+	});
+	return rv;
+}
+
+std::vector<size_t> esp::sort(const std::vector<std::string>& plugins, const std::vector<header>& headers) {
+	const size_t					n = plugins.size();
+	std::unordered_map<std::string, size_t>		idx;
+	for(size_t i = 0; i < n; ++i)
+		idx[utils::to_lower(plugins[i])] = i;
+	// edges from each master to the plugins which
+	// need it; masters not in the list are ignored
+	std::vector<std::vector<size_t>>		deps(n);
+	std::vector<size_t>				n_masters(n, 0);
+	for(size_t i = 0; i < n; ++i) {
+		for(const auto& m : headers[i].masters) {
+			const auto	it = idx.find(utils::to_lower(m));
+			if(it == idx.end() || it->second == i)
+				continue;
+			deps[it->second].push_back(i);
+			++n_masters[i];
+		}
+	}
+	// among the plugins ready to be loaded pick
+	// masters first, then the current position
+	typedef std::pair<int, size_t>			prio;
+	std::priority_queue<prio, std::vector<prio>, std::greater<prio>>	ready;
+	const auto	group = [&](const size_t i) -> int {
+		return ((headers[i].flags & F_MASTER) || is_master_ext(plugins[i])) ? 0 : 1;
+	};
+	for(size_t i = 0; i < n; ++i) {
+		if(!n_masters[i])
+			ready.push(prio(group(i), i));
+	}
+	std::vector<size_t>	rv;
+	std::vector<bool>	done(n, false);
+	rv.reserve(n);
+	while(!ready.empty()) {
+		const size_t	i = ready.top().second;
+		ready.pop();
+		rv.push_back(i);
+		done[i] = true;
+		for(const auto& d : deps[i]) {
+			if(!--n_masters[d])
+				ready.push(prio(group(d), d));
+		}
+	}
+	// plugins in a cycle of masters are
+	// left in their current order
+	if(rv.size() != n) {
+		LOG << "Cycle of masters found among " << (n - rv.size()) << " plugins";
+		for(size_t i = 0; i < n; ++i) {
+			if(!done[i])
+				rv.push_back(i);
+		}
+	}
+	return rv;
+}
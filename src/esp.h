@@ -0,0 +1,63 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _ESP_H_
+#define _ESP_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace esp {
+	// the TES4 record header flags we care about
+	enum header_flags {
+		F_MASTER = 0x00000001,
+		F_LIGHT = 0x00000200
+	};
+
+	// content of the TES4 record (the header)
+	// of an ESP/ESM/ESL file
+	struct header {
+		bool				valid;
+		uint32_t			flags;
+		std::vector<std::string>	masters;
+
+		header() : valid(false), flags(0) {
+		}
+	};
+
+	// reads only the TES4 record of file f_name,
+	// throws if the file can't be read or isn't
+	// a plugin
+	extern header read_header(const std::string& f_name);
+	// writes f_name as an empty, light (ESL flagged)
+	// plugin; used to have the game load a BSA
+	extern void write_dummy(const std::string& f_name);
+	// reads the headers of all plugins (names
+	// relative to data_dir, case insensitive) in
+	// parallel; plugins which can't be read
+	// get an invalid header
+	extern std::vector<header> scan(const std::string& data_dir, const std::vector<std::string>& plugins);
+	// returns the load order of plugins, as indexes
+	// into plugins: masters (flag or extension) go
+	// first, each plugin is loaded after its own
+	// masters, otherwise the current order is kept
+	extern std::vector<size_t> sort(const std::vector<std::string>& plugins, const std::vector<header>& headers);
+}
+
+#endif //_ESP_H_
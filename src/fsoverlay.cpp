@@ -17,26 +17,240 @@
 
 #include "fsoverlay.h"
 #include "utils.h"
+#include "bsa.h"
+#include "esp.h"
+#include "store.h"
+#include "watch.h"
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxml/xmlwriter.h>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
 #include <deque>
 #include <memory>
 #include <cstring>
 #include <fstream>
+#include <fcntl.h>
+#include <cstdio>
+#include <cinttypes>
 #include <unordered_set>
 #include <algorithm>
+#include <functional>
+#include <cerrno>
+#include <unordered_map>
+#include <climits>
+#include <cstdint>
+#include <regex>
+#include <sstream>
+#include <map>
 
 #define ISO_ENCODING "ISO-8859-1"
 
 namespace {
+	// reference to an interned path: 'dir' is the
+	// id of the parent directory node and 'leaf'
+	// the id of the last path component name
+	struct path_ref {
+		uint32_t	dir,
+				leaf;
+
+		bool operator==(const path_ref& rhs) const {
+			return dir == rhs.dir && leaf == rhs.leaf;
+		}
+
+		bool operator!=(const path_ref& rhs) const {
+			return !(*this == rhs);
+		}
+
+		uint64_t key(void) const {
+			return (static_cast<uint64_t>(dir) << 32) | leaf;
+		}
+	};
+
+	struct path_ref_hash {
+		size_t operator()(const path_ref& p) const {
+			return std::hash<uint64_t>()(p.key());
+		}
+	};
+
+	// all the paths managed by the overlay share
+	// most of their prefixes (i.e. the absolute
+	// override directory and the plugin name or
+	// 'textures/armor/...'), hence those get split
+	// into directory nodes and names, each stored
+	// only once; names live contiguously in a
+	// single char arena
+	class path_arena {
+		struct name_span {
+			uint32_t	off,
+					len;
+		};
+
+		struct dir_node {
+			uint32_t	parent,
+					name;
+		};
+
+		std::string			chars_;
+		std::vector<name_span>		names_;
+		std::vector<dir_node>		dirs_;
+		std::unordered_map<uint64_t, uint32_t>	dirs_idx_;
+
+		// hashing and equality of names are done
+		// directly on the arena, so the index
+		// only holds the names ids
+		struct name_hash {
+			const path_arena	*pa;
+
+			size_t operator()(const uint32_t id) const {
+				// FNV-1a
+				const auto&	n = pa->names_[id];
+				uint64_t	h = 14695981039346656037ULL;
+				for(uint32_t i = 0; i < n.len; ++i) {
+					h ^= static_cast<unsigned char>(pa->chars_[n.off + i]);
+					h *= 1099511628211ULL;
+				}
+				return h;
+			}
+		};
+
+		struct name_eq {
+			const path_arena	*pa;
+
+			bool operator()(const uint32_t lhs, const uint32_t rhs) const {
+				const auto	&l = pa->names_[lhs],
+						&r = pa->names_[rhs];
+				return (l.len == r.len) && !pa->chars_.compare(l.off, l.len, pa->chars_, r.off, r.len);
+			}
+		};
+
+		std::unordered_set<uint32_t, name_hash, name_eq>	names_idx_;
+
+		path_arena(const path_arena&) = delete;
+		path_arena& operator=(const path_arena&) = delete;
+
+		uint32_t intern_name(const char* p, const size_t len) {
+			// tentatively append the name, then
+			// rollback if it was already present
+			const uint32_t	id = names_.size();
+			names_.push_back({static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(len)});
+			chars_.append(p, len);
+			const auto	it = names_idx_.find(id);
+			if(it != names_idx_.end()) {
+				chars_.resize(names_.back().off);
+				names_.pop_back();
+				return *it;
+			}
+			names_idx_.insert(id);
+			return id;
+		}
+
+		uint32_t intern_dir(const uint32_t parent, const uint32_t name) {
+			const uint64_t	k = (static_cast<uint64_t>(parent) << 32) | name;
+			const auto	it = dirs_idx_.find(k);
+			if(it != dirs_idx_.end())
+				return it->second;
+			const uint32_t	id = dirs_.size();
+			dirs_.push_back({parent, name});
+			dirs_idx_[k] = id;
+			return id;
+		}
+public:
+		path_arena() : names_idx_(0, name_hash{this}, name_eq{this}) {
+			// node 0 is the root sentinel, parent
+			// of all the first path components
+			dirs_.push_back({0, 0});
+		}
+
+		path_ref intern(const std::string& path) {
+			uint32_t	dir = 0;
+			size_t		start = 0,
+					p_slash = 0;
+			while((p_slash = path.find('/', start)) != std::string::npos) {
+				dir = intern_dir(dir, intern_name(path.c_str() + start, p_slash - start));
+				start = p_slash + 1;
+			}
+			return path_ref{dir, intern_name(path.c_str() + start, path.length() - start)};
+		}
+
+		// appends the path referenced by p to out,
+		// so callers can reuse the same buffer
+		void append(std::string& out, const path_ref& p) const {
+			// the parents are walked leaf first, hence
+			// size the path upfront and fill it from
+			// the end, whatever its depth
+			const auto&	lf = names_[p.leaf];
+			size_t		len = lf.len;
+			for(uint32_t d = p.dir; d != 0; d = dirs_[d].parent)
+				len += names_[dirs_[d].name].len + 1;
+			size_t		pos = out.length() + len;
+			out.resize(pos);
+			pos -= lf.len;
+			std::memcpy(&out[pos], chars_.data() + lf.off, lf.len);
+			for(uint32_t d = p.dir; d != 0; d = dirs_[d].parent) {
+				const auto&	nm = names_[dirs_[d].name];
+				out[--pos] = '/';
+				pos -= nm.len;
+				std::memcpy(&out[pos], chars_.data() + nm.off, nm.len);
+			}
+		}
+
+		std::string str(const path_ref& p) const {
+			std::string	out;
+			append(out, p);
+			return out;
+		}
+	};
+
+	path_arena			PATHS;
+
+	// identity of a file (not following symlinks) as
+	// last found correct: replacing it or writing
+	// to it changes it; all zeros when unknown
+	struct fingerprint {
+		uint64_t	dev,
+				ino,
+				size;
+		int64_t		mtime_ns;
+
+		bool operator==(const fingerprint& rhs) const {
+			return ino && dev == rhs.dev && ino == rhs.ino && size == rhs.size && mtime_ns == rhs.mtime_ns;
+		}
+
+		static fingerprint from(const struct stat& st) {
+			return { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec };
+		}
+
+		static fingerprint of(const std::string& f) {
+			struct stat	st;
+			if(fstatat(AT_FDCWD, f.c_str(), &st, AT_SYMLINK_NOFOLLOW))
+				return { 0, 0, 0, 0 };
+			return from(st);
+		}
+
+		// 'dev:ino:size:mtime_ns' in the overlay config
+		std::string str(void) const {
+			return std::to_string(dev) + ':' + std::to_string(ino) + ':' + std::to_string(size) + ':' + std::to_string(mtime_ns);
+		}
+
+		static fingerprint parse(const char* s) {
+			fingerprint	rv = { 0, 0, 0, 0 };
+			long long	mt = 0;
+			if(4 != std::sscanf(s, "%" SCNu64 ":%" SCNu64 ":%" SCNu64 ":%lld", &rv.dev, &rv.ino, &rv.size, &mt))
+				return { 0, 0, 0, 0 };
+			rv.mtime_ns = mt;
+			return rv;
+		}
+	};
+
 	struct f_data {
-		std::string	r_file,
+		path_ref	r_file,
 				sym_file;
+		fingerprint	r_fp,
+				sym_fp;
 	};
 
 	struct p_data {
@@ -48,14 +262,50 @@ namespace {
 
 	p_list				PLUGINS_LIST;
 
+	// named subsets of PLUGINS_LIST
+	typedef std::map<std::string, std::vector<std::string>>	prof_map;
+
+	prof_map			PROFILES;
+
+	utils::deploy_mode		DEPLOY_MODE = utils::deploy_mode::SYMLINK;
+
+	// identity of the last config loaded into
+	// PLUGINS_LIST, so a long running process
+	// only parses it again once it got replaced
+	struct xml_id {
+		std::string	path;
+		bool		exists;
+		fingerprint	fp;
+
+		bool operator==(const xml_id& rhs) const {
+			return path == rhs.path && exists == rhs.exists && (!exists || fp == rhs.fp);
+		}
+	};
+
+	std::unique_ptr<xml_id>		LOADED_XML;
+
+	xml_id get_xml_id(const std::string& f) {
+		xml_id		rv = { f, false, { 0, 0, 0, 0 } };
+		struct stat	st;
+		if(!stat(f.c_str(), &st)) {
+			rv.exists = true;
+			rv.fp = fingerprint::from(st);
+		}
+		return rv;
+	}
+
 	typedef utils::XmlCharHolder	xc;
 
 	const std::string		N_ROOT_CFG("skyrim-pm-fsoverlay-config"),
 					N_PLUGIN("plugin"),
 					N_ENTRY("entry"),
+					N_PROFILE("profile"),
 					A_NAME("name"),
 					A_FSPATH("fspath"),
-					A_DPATH("datapath");
+					A_DPATH("datapath"),
+					A_DEPLOY("deploy"),
+					A_FSFP("fsfp"),
+					A_DFP("datafp");
 
 	struct xel_w {
 		xmlTextWriterPtr w;
@@ -75,7 +325,44 @@ namespace {
 		}
 	};
 
-	void rec_dir_scan(const std::string& d_name, const std::string& base_data, const std::string& base_plugin, p_data& d_plugin) {
+	// a single link update: if 'target' is
+	// empty the link is just removed
+	struct link_op {
+		std::string	sym_path,
+				target;
+	};
+
+	// what the current mode deploys, for the reports
+	std::string deployed_name(void) {
+		return (utils::deploy_mode::FUSE == DEPLOY_MODE) ? "fuse entries" : std::string(utils::deploy_mode_name(DEPLOY_MODE)) + "s";
+	}
+
+	// with fuse nothing is deployed under Data,
+	// the config is all the --fuse-mount view needs
+	void apply_link_ops(const std::vector<link_op>& ops) {
+		if(utils::deploy_mode::FUSE == DEPLOY_MODE)
+			return;
+		utils::parallel_for(ops.size(), [&ops](const size_t i) -> void {
+			const auto&	op = ops[i];
+			remove(op.sym_path.c_str());
+			if(op.target.empty())
+				return;
+			if(!utils::deploy_link(op.target, op.sym_path, DEPLOY_MODE))
+				return;
+			// the parent directory may be missing
+			// (i.e. when redeploying)
+			if(errno == ENOENT) {
+				utils::ensure_fname_path(op.sym_path);
+				if(!utils::deploy_link(op.target, op.sym_path, DEPLOY_MODE))
+					return;
+			}
+			throw std::runtime_error(std::string("overlay ") + utils::deploy_mode_name(DEPLOY_MODE) + " failed for '" + op.target + "' --> '" + op.sym_path + "' [" + std::strerror(errno) + "]");
+		});
+	}
+
+	// invokes fn(sym_name, r_file) for each symlink
+	// found recursively under d_name
+	void rec_dir_symlinks(const std::string& d_name, const std::function<void(const std::string&, const char*)>& fn) {
 		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(d_name.c_str()), closedir);
 		if(!d)
 			throw std::runtime_error(std::string("Can't open '") + d_name + "' to scan for symlinks");
@@ -84,31 +371,92 @@ namespace {
 			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
 				continue;
 			if(DT_DIR == de->d_type) {
-				rec_dir_scan((std::string(d_name) + '/' + de->d_name).c_str(), base_data, base_plugin, d_plugin);
+				rec_dir_symlinks(std::string(d_name) + '/' + de->d_name, fn);
 			} else if(DT_LNK == de->d_type) {
-				// if it's a link, get the link
-				// and ensure the basepath is
-				// as expected
 				char			r_file[1024];
 				ssize_t			r_sz = -1;
 				const std::string	sym_name = std::string(d_name) + '/' + de->d_name;
-				if((r_sz = readlink(sym_name.c_str(), r_file, sizeof(r_file)-1)) != -1)
-					r_file[r_sz] = '\0';
-				if(r_file == strstr(r_file, base_plugin.c_str())) {
-					d_plugin.files.push_back({r_file, sym_name.substr(base_data.length()+1)});
-				}
+				if((r_sz = readlink(sym_name.c_str(), r_file, sizeof(r_file)-1)) == -1)
+					continue;
+				r_file[r_sz] = '\0';
+				fn(sym_name, r_file);
+			}
+		}
+	}
+
+	// invokes fn(rel_name) for each regular file found
+	// recursively under d_name ('/' terminated), with
+	// rel_name relative to it
+	void rec_dir_files(const std::string& d_name, const std::function<void(const std::string&)>& fn, const std::string& rel = "") {
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir((d_name + rel).c_str()), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't open '") + d_name + rel + "' to scan for files");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get()))) {
+			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+				continue;
+			if(DT_DIR == de->d_type) {
+				rec_dir_files(d_name, fn, rel + de->d_name + '/');
+			} else if(DT_REG == de->d_type) {
+				fn(rel + de->d_name);
 			}
 		}
 	}
+	// the game loads the BSAs named after a plugin
+	// (<plugin>.bsa and <plugin> - Textures.bsa) with
+	// it: the base masters first, then the enabled
+	// plugins of Plugins.txt in order. Returns the
+	// lowercase plugin names, without extension, to
+	// their load position from 1 on
+	std::unordered_map<std::string, size_t> bsa_load_order(const std::string& plugins_file) {
+		const static std::regex	ext_regex("\\.es[pml]$" , std::regex_constants::ECMAScript | std::regex_constants::icase);
+		std::unordered_map<std::string, size_t>	rv;
+		for(const char* m : { "skyrim", "update", "dawnguard", "hearthfires", "dragonborn" })
+			rv.insert(std::make_pair(m, rv.size() + 1));
+		std::ifstream	istr(plugins_file);
+		std::string	line;
+		while(std::getline(istr, line)) {
+			line = utils::trim(line);
+			if(line.length() < 2 || line[0] != '*' || !std::regex_search(line, ext_regex))
+				continue;
+			rv.insert(std::make_pair(utils::to_lower(line.substr(1, line.length() - 5)), rv.size() + 1));
+		}
+		return rv;
+	}
+
+	// load position of a BSA, 0 when not loaded along a
+	// plugin (i.e. the base game ones, listed in the ini)
+	size_t bsa_rank(const std::unordered_map<std::string, size_t>& order, const std::string& bsa_file) {
+		const static std::string	TEXTURES(" - textures");
+		auto				name = utils::to_lower(utils::file_name(bsa_file));
+		name.resize(name.length() - 4);
+		auto				it = order.find(name);
+		if(it == order.end() && name.length() > TEXTURES.length() && !name.compare(name.length() - TEXTURES.length(), std::string::npos, TEXTURES))
+			it = order.find(name.substr(0, name.length() - TEXTURES.length()));
+		return (it == order.end()) ? 0 : it->second;
+	}
 }
 
 void fso::load_xml(const std::string& f) {
+	const auto	cur_id = get_xml_id(f);
+	if(LOADED_XML && *LOADED_XML == cur_id) {
+		LOG << "Fsoverlay config '" << f << "' already loaded";
+		return;
+	}
 	LOG << "Trying to load fsoverlay config '" << f << "'";
+	// start from scratch, the config may have
+	// been loaded before; it's marked as loaded
+	// only once fully read, so that any error
+	// gets it reloaded next time
+	fso::reset();
+	DEPLOY_MODE = utils::deploy_mode::SYMLINK;
 	// check file exists first
 	{
 		std::ifstream	istr(f);
-		if(!istr)
+		if(!istr) {
+			LOADED_XML.reset(new xml_id(cur_id));
 			return;
+		}
 	}
 
 	std::unique_ptr<xmlDoc, void (*)(xmlDoc*)>	doc(xmlReadFile(f.c_str(), NULL, 0), xmlFreeDoc);
@@ -124,9 +472,29 @@ void fso::load_xml(const std::string& f) {
 	auto	re = xmlDocGetRootElement(doc.get());
 	if(N_ROOT_CFG != (const char*)re->name)
 		throw std::runtime_error("Invalid fsoverlay config");
+	// no deploy mode means symlinks
+	const xc	dm(xmlGetProp(re, (const xmlChar*)A_DEPLOY.c_str()));
+	DEPLOY_MODE = (dm) ? utils::parse_deploy_mode(dm.c_str()) : utils::deploy_mode::SYMLINK;
 	for(auto c = re->children; c; c = c->next) {
 		if(c->type != XML_ELEMENT_NODE)
 			continue;
+		// profile (name=...)
+		// +-- plugin (name=...)
+		if(N_PROFILE == (const char*)c->name) {
+			const xc	nm(xmlGetProp(c, (const xmlChar*)A_NAME.c_str()));
+			if(!nm)
+				throw std::runtime_error("Invalid fsoverlay 'profile' entry");
+			auto&	prof = PROFILES[nm.c_str()];
+			for(auto pc = c->children; pc; pc = pc->next) {
+				if(pc->type != XML_ELEMENT_NODE || N_PLUGIN != (const char*)pc->name)
+					continue;
+				const xc	p_nm(xmlGetProp(pc, (const xmlChar*)A_NAME.c_str()));
+				if(!p_nm)
+					throw std::runtime_error("Invalid fsoverlay 'profile' plugin entry");
+				prof.push_back(p_nm.c_str());
+			}
+			continue;
+		}
 		if(N_PLUGIN != (const char*)c->name)
 			continue;
 		// get the 'name' attribute
@@ -147,10 +515,16 @@ void fso::load_xml(const std::string& f) {
 				throw std::runtime_error("Invalid fsoverlay 'entry' - no 'fspath' attribute");
 			if(!datapath)
 				throw std::runtime_error("Invalid fsoverlay 'entry' - no 'datapath' attribute");
-			cur_p.files.push_back({fspath.c_str(), datapath.c_str()});
+			// fingerprints are optional
+			const xc	fsfp(xmlGetProp(ec, (const xmlChar*)A_FSFP.c_str())),
+					dfp(xmlGetProp(ec, (const xmlChar*)A_DFP.c_str()));
+			cur_p.files.push_back({PATHS.intern(fspath.c_str()), PATHS.intern(datapath.c_str()),
+					       fsfp ? fingerprint::parse(fsfp.c_str()) : fingerprint{ 0, 0, 0, 0 },
+					       dfp ? fingerprint::parse(dfp.c_str()) : fingerprint{ 0, 0, 0, 0 }});
 		}
 		PLUGINS_LIST.emplace_back(cur_p);
 	}
+	LOADED_XML.reset(new xml_id(cur_id));
 }
 
 void fso::list_plugin(std::ostream& ostr) {
@@ -162,16 +536,17 @@ void fso::list_plugin(std::ostream& ostr) {
 
 void fso::list_replace(std::ostream& ostr) {
 	ostr << "\t" << utils::term::blue("Overrides/Plugins replaced files:") << "\n";
-	std::unordered_set<std::string>	processed_sym;
+	std::unordered_set<path_ref, path_ref_hash>	processed_sym;
 
 	// this is full linear scan, very unpotimized
+	// but paths comparisons are on interned ids
 	for(auto i = PLUGINS_LIST.rbegin(); i != PLUGINS_LIST.rend(); ++i) {
 		for(const auto& s : i->files) {
 			if(processed_sym.find(s.sym_file) != processed_sym.end())
 				continue;
 			// now, search the plugin list in reverse order to find out
 			// if we have any other conflict/replacement
-			std::vector<std::string>	r_files;
+			std::vector<path_ref>	r_files;
 			for(auto j = i+1; j != PLUGINS_LIST.rend(); ++j) {
 				for(const auto& sr : j->files) {
 					if(sr.sym_file == s.sym_file)
@@ -180,96 +555,434 @@ void fso::list_replace(std::ostream& ostr) {
 			}
 			// if we have some replacement, then print
 			if(!r_files.empty()) {
-				ostr << utils::term::bold(s.sym_file) << '\n';
-				ostr << '\t' << utils::term::green(s.r_file) << '\n';
+				ostr << utils::term::bold(PATHS.str(s.sym_file)) << '\n';
+				ostr << '\t' << utils::term::green(PATHS.str(s.r_file)) << '\n';
 				for(const auto& rf : r_files)
-					ostr << '\t' << utils::term::yellow(rf) << '\n';
+					ostr << '\t' << utils::term::yellow(PATHS.str(rf)) << '\n';
 			}
 			processed_sym.insert(s.sym_file);
 		}
 	}
 }
 
-void fso::list_verify(std::ostream& ostr, const std::string& data_dir) {
-	ostr << "\t" << utils::term::blue("Overrides/Plugins verification (missing files/invalid symlinks):") << "\n";
-	std::unordered_set<std::string>	processed_sym;
+void fso::list_bsa_replace(std::ostream& ostr, const std::string& data_dir, const std::string& plugins_file) {
+	ostr << "\t" << utils::term::blue(std::string("Overrides/Plugins replaced assets (loose files and BSAs, BSAs ranked by ") + (plugins_file.empty() ? "install order" : "Plugins.txt load order") + "):") << "\n";
+	// all the BSAs to be read: the ones of the plugins
+	// and the ones directly in Data (i.e. base game),
+	// the latter with source 0 and plugins from 1 on
+	struct bsa_src {
+		size_t				src;
+		std::string			file;
+		std::vector<std::string>	assets;
+		std::string			error;
+		size_t				rank;
+	};
+	const static std::regex		bsa_regex("\\.bsa$" , std::regex_constants::ECMAScript | std::regex_constants::icase);
+	std::vector<bsa_src>		bsas;
+	{
+		// the deployed BSAs of the plugins may not
+		// be symlinks (i.e. hard links)
+		std::unordered_set<std::string>		managed;
+		for(const auto& p : PLUGINS_LIST) {
+			for(const auto& f : p.files)
+				managed.insert(PATHS.str(f.sym_file));
+		}
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(data_dir.c_str()), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't open '") + data_dir + "' to scan for BSAs");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get()))) {
+			if(DT_LNK != de->d_type && std::regex_search(de->d_name, bsa_regex) && !managed.count(de->d_name))
+				bsas.push_back({0, data_dir + de->d_name, {}, "", 0});
+		}
+	}
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		for(const auto& f : PLUGINS_LIST[i].files) {
+			const auto	r_file = PATHS.str(f.r_file);
+			if(std::regex_search(r_file, bsa_regex))
+				bsas.push_back({i+1, r_file, {}, "", 0});
+		}
+	}
+	// without Plugins.txt all the ranks are 0
+	// and install order is used instead
+	if(!plugins_file.empty()) {
+		const auto	order = bsa_load_order(plugins_file);
+		for(auto& b : bsas)
+			b.rank = bsa_rank(order, b.file);
+	}
+	// each BSA is read on its own thread
+	utils::parallel_for(bsas.size(), [&bsas](const size_t i) {
+		try {
+			bsa::list(bsas[i].file, bsas[i].assets);
+		} catch(const std::exception& e) {
+			bsas[i].error = e.what();
+		}
+	}, 1);
+	// then build the combined index, in a single pass,
+	// of who provides each asset: 'bsa' is the index
+	// in bsas or -1 for loose files
+	struct provider {
+		size_t	src,
+			bsa;
+	};
+	const size_t						LOOSE = (size_t)-1;
+	std::unordered_map<std::string, std::vector<provider>>	assets;
+	for(size_t i = 0; i < bsas.size(); ++i) {
+		if(!bsas[i].error.empty()) {
+			ostr << utils::term::red(bsas[i].error) << '\n';
+			continue;
+		}
+		for(const auto& a : bsas[i].assets)
+			assets[a].push_back({bsas[i].src, i});
+	}
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		for(const auto& f : PLUGINS_LIST[i].files)
+			assets[utils::to_lower(PATHS.str(f.sym_file))].push_back({i+1, LOOSE});
+	}
+	// report only the assets provided by multiple
+	// sources, a BSA being one of them; loose files
+	// always win over BSAs, then the BSA loaded last
+	std::vector<std::string>	conflicts;
+	for(const auto& a : assets) {
+		bool	has_bsa = false,
+			multi_src = false;
+		for(const auto& p : a.second) {
+			has_bsa |= (p.bsa != LOOSE);
+			multi_src |= (p.src != a.second[0].src);
+		}
+		if(has_bsa && multi_src)
+			conflicts.push_back(a.first);
+	}
+	std::sort(conflicts.begin(), conflicts.end());
+	const auto	src_name = [](const size_t src) -> std::string {
+		return (src) ? PLUGINS_LIST[src-1].p_name : "<Data>";
+	};
+	for(const auto& c : conflicts) {
+		auto	pv = assets[c];
+		std::stable_sort(pv.begin(), pv.end(), [&bsas](const provider& lhs, const provider& rhs) {
+			const bool	l_loose = (lhs.bsa == LOOSE),
+					r_loose = (rhs.bsa == LOOSE);
+			if(l_loose != r_loose)
+				return l_loose;
+			if(!l_loose && bsas[lhs.bsa].rank != bsas[rhs.bsa].rank)
+				return bsas[lhs.bsa].rank > bsas[rhs.bsa].rank;
+			return lhs.src > rhs.src;
+		});
+		ostr << utils::term::bold(c) << '\n';
+		for(size_t i = 0; i < pv.size(); ++i) {
+			std::stringstream	sstr;
+			sstr << src_name(pv[i].src) << '\t' << ((pv[i].bsa == LOOSE) ? "loose" : utils::file_name(bsas[pv[i].bsa].file));
+			ostr << '\t' << (i ? utils::term::yellow(sstr.str()) : utils::term::green(sstr.str())) << '\n';
+		}
+	}
+}
+
+bool fso::list_verify(std::ostream& ostr, const std::string& data_dir, const watch::dirty_set* dirty, size_t* fp_updated) {
+	ostr << "\t" << utils::term::blue("Overrides/Plugins verification (missing files/invalid " + deployed_name() + "):") << "\n";
+	std::unordered_set<path_ref, path_ref_hash>	processed_sym;
+	std::string					r_path,
+							sym_path;
+	size_t						n_checked = 0;
+	bool						all_ok = true;
 
 	for(auto i = PLUGINS_LIST.rbegin(); i != PLUGINS_LIST.rend(); ++i) {
-		std::vector<std::string>	r_files_missing,
-						sym_missing;
-		for(const auto& s : i->files) {
+		std::vector<path_ref>	r_files_missing,
+					sym_missing;
+		for(auto& s : i->files) {
 			const bool	check_symlink = (processed_sym.find(s.sym_file) == processed_sym.end());
+			r_path.clear();
+			PATHS.append(r_path, s.r_file);
+			sym_path = data_dir;
+			PATHS.append(sym_path, s.sym_file);
+			processed_sym.insert(s.sym_file);
+			// unchanged entries are still
+			// as last found correct
+			if(dirty && !dirty->is_dirty(r_path) && !dirty->is_dirty(sym_path))
+				continue;
+			++n_checked;
+			// with fingerprints, files still as when last
+			// found correct don't get checked further
+			const fingerprint	r_fp = fp_updated ? fingerprint::of(r_path) : fingerprint{ 0, 0, 0, 0 },
+						sym_fp = (fp_updated && check_symlink) ? fingerprint::of(sym_path) : fingerprint{ 0, 0, 0, 0 };
 			// check the real file first
-			std::ifstream	rf_s(s.r_file, std::ios_base::binary);
-			if(!rf_s) {
-				r_files_missing.emplace_back(s.r_file);
+			if(!(r_fp == s.r_fp)) {
+				std::ifstream	rf_s(r_path, std::ios_base::binary);
+				if(!rf_s) {
+					r_files_missing.emplace_back(s.r_file);
+				} else if(r_fp.ino) {
+					s.r_fp = r_fp;
+					++*fp_updated;
+				}
 			}
-			if(check_symlink) {
-				char			r_file[1024];
-				ssize_t			r_sz = -1;
-				if((r_sz = readlink((data_dir + s.sym_file).c_str(), r_file, sizeof(r_file)-1)) != -1)
-					r_file[r_sz] = '\0';
-				if(r_sz == -1 || s.r_file != r_file)
+			if(check_symlink && !(sym_fp == s.sym_fp)) {
+				if(!utils::is_deployed(r_path, sym_path, DEPLOY_MODE)) {
 					sym_missing.emplace_back(s.sym_file);
+				} else if(sym_fp.ino) {
+					s.sym_fp = sym_fp;
+					++*fp_updated;
+				}
 			}
-			processed_sym.insert(s.sym_file);
 		}
 		if((r_files_missing.size() + sym_missing.size()) > 0) {
+			all_ok = false;
 			ostr << utils::term::bold(i->p_name) << '\n';
 			for(const auto& f: r_files_missing) {
-				ostr << '\t' << "File\t" << utils::term::red(f) << '\n';
+				ostr << '\t' << "File\t" << utils::term::red(PATHS.str(f)) << '\n';
 			}
 			for(const auto& f: sym_missing) {
-				ostr << '\t' << "Sym\t" << utils::term::red(f) << '\n';
+				ostr << '\t' << "Sym\t" << utils::term::red(PATHS.str(f)) << '\n';
 			}
 		}
 	}
+	if(dirty)
+		LOG << "Verified " << n_checked << " changed entries";
+	return all_ok;
+}
 
+void fso::list_remove(std::ostream& ostr, const std::vector<std::string>& p_names, const std::string& data_dir, const std::string& ovd_dir) {
+	// first mark all the plugins to be removed
+	std::unordered_set<std::string>	rm_names(p_names.begin(), p_names.end());
+	std::vector<bool>		rm_plugin(PLUGINS_LIST.size(), false);
+	std::unordered_set<std::string>	found;
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		if(rm_names.find(PLUGINS_LIST[i].p_name) == rm_names.end())
+			continue;
+		rm_plugin[i] = true;
+		found.insert(PLUGINS_LIST[i].p_name);
+	}
+	// collect all the symlinks affected by the removal
+	// and all the real files to be deleted
+	std::unordered_map<path_ref, const f_data*, path_ref_hash>	winners;
+	std::vector<path_ref>						r_files;
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		if(!rm_plugin[i])
+			continue;
+		for(const auto& s : PLUGINS_LIST[i].files) {
+			winners[s.sym_file] = 0;
+			r_files.push_back(s.r_file);
+		}
+	}
+	// now compute the final winner of each affected
+	// symlink across all remaining plugins, last one
+	// in list order takes precedence
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		if(rm_plugin[i])
+			continue;
+		for(const auto& s : PLUGINS_LIST[i].files) {
+			auto	it = winners.find(s.sym_file);
+			if(it != winners.end())
+				it->second = &s;
+		}
+	}
+	// each symlink gets either restored to its
+	// fallback or removed exactly once
+	std::vector<link_op>	ops;
+	ops.reserve(winners.size());
+	for(const auto& w : winners) {
+		link_op	op;
+		op.sym_path = data_dir;
+		PATHS.append(op.sym_path, w.first);
+		if(w.second)
+			PATHS.append(op.target, w.second->r_file);
+		ops.emplace_back(op);
+	}
+	apply_link_ops(ops);
+	// no matter what, remove the real files; the ones
+	// shared with others (i.e. store blobs) are
+	// collected to then drop the unreferenced blobs
+	std::vector<ino_t>	r_inodes(r_files.size(), 0);
+	utils::parallel_for(r_files.size(), [&r_files, &r_inodes](const size_t i) -> void {
+		const auto	r_file = PATHS.str(r_files[i]);
+		struct stat	s = {0};
+		if(!lstat(r_file.c_str(), &s) && s.st_nlink > 1)
+			r_inodes[i] = s.st_ino;
+		remove(r_file.c_str());
+	});
+	std::unordered_set<ino_t>	shared;
+	for(const auto& i : r_inodes) {
+		if(i)
+			shared.insert(i);
+	}
+	store::gc(store::dir(ovd_dir), shared);
+	LOG << "Removed " << r_files.size() << " files, relinked/removed " << ops.size() << " links";
+	for(const auto& p_name : p_names) {
+		if(found.find(p_name) != found.end()) {
+			ostr << utils::term::blue(p_name + " removed") << '\n';
+		} else {
+			ostr << utils::term::yellow(p_name + " not removed, could not be found") << '\n';
+		}
+	}
+	// remove the entries from the PLUGINS_LIST variable
+	auto	rmit = std::remove_if(PLUGINS_LIST.begin(), PLUGINS_LIST.end(), [&rm_names](const p_data& v) -> bool { return rm_names.find(v.p_name) != rm_names.end(); });
+	PLUGINS_LIST.erase(rmit, PLUGINS_LIST.end());
+	// and from the profiles
+	for(auto& pr : PROFILES) {
+		auto	prit = std::remove_if(pr.second.begin(), pr.second.end(), [&rm_names](const std::string& n) -> bool { return rm_names.find(n) != rm_names.end(); });
+		pr.second.erase(prit, pr.second.end());
+	}
 }
 
-void fso::list_remove(std::ostream& ostr, const std::string& p_name, const std::string& data_dir) {
-	for(auto i = PLUGINS_LIST.rbegin(); i != PLUGINS_LIST.rend(); ++i) {
-		if(i->p_name != p_name)
+void fso::redeploy(std::ostream& ostr, const std::string& data_dir, const std::string& ovd_dir, const watch::dirty_set* dirty) {
+	ostr << "\t" << utils::term::blue("Overrides/Plugins redeploy:") << "\n";
+	// compute the winning file for each symlink,
+	// last plugin in list order takes precedence
+	std::unordered_map<path_ref, path_ref, path_ref_hash>	winners;
+	for(const auto& p : PLUGINS_LIST) {
+		for(const auto& s : p.files)
+			winners[s.sym_file] = s.r_file;
+	}
+	std::vector<link_op>	expected;
+	expected.reserve(winners.size());
+	for(const auto& w : winners) {
+		link_op	op;
+		op.sym_path = data_dir;
+		PATHS.append(op.sym_path, w.first);
+		PATHS.append(op.target, w.second);
+		expected.emplace_back(op);
+	}
+	// diff against what is currently under Data,
+	// unless known to be unchanged
+	std::vector<char>	differs(expected.size(), 0);
+	const bool		fuse = (utils::deploy_mode::FUSE == DEPLOY_MODE);
+	utils::parallel_for(expected.size(), [&expected, &differs, dirty, fuse](const size_t i) -> void {
+		if(dirty && !dirty->is_dirty(expected[i].target) && !dirty->is_dirty(expected[i].sym_path))
+			return;
+		// with fuse the hard links and reflinks
+		// of the other modes are left to remove
+		if(fuse)
+			differs[i] = utils::is_deployed(expected[i].target, expected[i].sym_path, utils::deploy_mode::HARDLINK) || utils::is_deployed(expected[i].target, expected[i].sym_path, utils::deploy_mode::REFLINK);
+		else
+			differs[i] = !utils::is_deployed(expected[i].target, expected[i].sym_path, DEPLOY_MODE);
+	});
+	std::vector<link_op>	ops;
+	for(size_t i = 0; i < expected.size(); ++i) {
+		if(!differs[i])
 			continue;
-		// now, for all entries, pick the symlink
-		// and for each one of those try to find first fallback
-		for(const auto& s : i->files) {
-			const auto&	cur_sym = s.sym_file;
-			std::string	prev_file;
-			for(auto j = i+1; j != PLUGINS_LIST.rend(); ++j) {
-				for(const auto& fj : j->files) {
-					if(fj.sym_file == cur_sym) {
-						prev_file = fj.r_file;
-						break;
-					}
-				}
-				// means we found something
-				if(!prev_file.empty())
-					break;
-			}
-			// if we got a prev_file then setup the new symlink
-			// and delete the original file
-			const auto	sym_path = data_dir + cur_sym;
-			if(!prev_file.empty()) {
-				remove(sym_path.c_str());
-				if(symlink(prev_file.c_str(), sym_path.c_str()))
-					throw std::runtime_error(std::string("overlay symlink failed for '") + prev_file + "' --> '" + sym_path + "'");
-				LOG << "Overlay old symlink '" << sym_path << "' from '" << prev_file << "'";
-			} else {
-				remove(sym_path.c_str());
-				LOG << "symlink '" << sym_path << "' removed";
+		if(fuse) {
+			LOG << "Redeploy removed '" << expected[i].sym_path << "'";
+			ops.push_back({expected[i].sym_path, ""});
+		} else {
+			LOG << "Redeploy " << utils::deploy_mode_name(DEPLOY_MODE) << " '" << expected[i].sym_path << "' --> '" << expected[i].target << "'";
+			ops.emplace_back(expected[i]);
+		}
+	}
+	const size_t	n_fixed = ops.size();
+	// also drop the symlinks pointing into the override
+	// directory which are not managed anymore (managed
+	// ones left by another deploy mode got replaced);
+	// with fuse none is
+	std::unordered_set<std::string>	managed;
+	if(!fuse) {
+		for(const auto& e : expected)
+			managed.insert(e.sym_path);
+	}
+	std::unordered_set<std::string>	stale;
+	const auto	fn_stale = [&](const std::string& sym_name, const char* r_file) -> void {
+		if(r_file != strstr(r_file, ovd_dir.c_str()))
+			return;
+		if(managed.find(sym_name) != managed.end())
+			return;
+		// changed paths can be nested
+		if(!stale.insert(sym_name).second)
+			return;
+		LOG << "Redeploy stale symlink '" << sym_name << "' removed";
+		ops.push_back({sym_name, ""});
+	};
+	if(!dirty || dirty->all()) {
+		rec_dir_symlinks(data_dir.substr(0, data_dir.length()-1), fn_stale);
+	} else {
+		// only where Data changed
+		dirty->for_each(data_dir, [&fn_stale](const std::string& p) -> void {
+			struct stat	st;
+			if(lstat(p.c_str(), &st))
+				return;
+			if(S_ISDIR(st.st_mode)) {
+				rec_dir_symlinks(p, fn_stale);
+			} else if(S_ISLNK(st.st_mode)) {
+				char		r_file[1024];
+				const ssize_t	r_sz = readlink(p.c_str(), r_file, sizeof(r_file)-1);
+				if(r_sz == -1)
+					return;
+				r_file[r_sz] = '\0';
+				fn_stale(p, r_file);
 			}
-			// no matter what, remove the real file
-			remove(s.r_file.c_str());
-			LOG << "file '" << s.r_file << "' removed";
-		}
-		ostr << utils::term::blue(p_name + " removed") << '\n';
-		// remove the iterator from the PLUGINS_LIST variable
-		auto	rmit = std::remove_if(PLUGINS_LIST.begin(), PLUGINS_LIST.end(), [&p_name](const p_data& v) -> bool { return v.p_name == p_name; });
-		PLUGINS_LIST.erase(rmit, PLUGINS_LIST.end());
-		return;
+		});
+	}
+	if(fuse) {
+		utils::parallel_for(ops.size(), [&ops](const size_t i) -> void {
+			remove(ops[i].sym_path.c_str());
+		});
+	} else {
+		apply_link_ops(ops);
+	}
+	ostr << expected.size() << " " << deployed_name() << " checked, " << n_fixed << " fixed, " << (ops.size() - n_fixed) << " stale removed" << std::endl;
+}
+
+void fso::move_plugin(std::ostream& ostr, const std::string& p_name, const std::string& tgt_name, const bool after, const std::string& data_dir) {
+	auto fn_find = [](const std::string& n) -> size_t {
+		for(size_t i = 0; i < PLUGINS_LIST.size(); ++i)
+			if(PLUGINS_LIST[i].p_name == n)
+				return i;
+		throw std::runtime_error(std::string("Can't find plugin '") + n + "' in list of managed plugins");
+	};
+	const size_t	src = fn_find(p_name),
+			tgt = fn_find(tgt_name);
+	if(src == tgt)
+		throw std::runtime_error("Can't move a plugin before/after itself");
+	// compute the new list position of the
+	// moved plugin; all the others preserve
+	// their relative order
+	size_t		dst = after ? tgt + 1 : tgt;
+	if(src < dst)
+		--dst;
+	auto fn_new_pos = [src, dst](const size_t i) -> size_t {
+		if(i == src)
+			return dst;
+		if(src < dst && i > src && i <= dst)
+			return i - 1;
+		if(dst < src && i >= dst && i < src)
+			return i + 1;
+		return i;
+	};
+	// only the paths of the moved plugin can change
+	// winner, build their ownership index
+	typedef std::vector<std::pair<size_t, path_ref>>	owners_t;
+	std::unordered_map<path_ref, owners_t, path_ref_hash>	owners;
+	for(const auto& s : PLUGINS_LIST[src].files)
+		owners[s.sym_file];
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		for(const auto& s : PLUGINS_LIST[i].files) {
+			auto	it = owners.find(s.sym_file);
+			if(it != owners.end())
+				it->second.emplace_back(i, s.r_file);
+		}
 	}
-	ostr << utils::term::yellow(p_name + " not removed, could not be found") << '\n';
+	// relink only the conflicted paths whose
+	// winner changes with the new order
+	std::vector<link_op>	ops;
+	for(const auto& o : owners) {
+		if(o.second.size() < 2)
+			continue;
+		const auto	*n_winner = &o.second.front();
+		for(const auto& i : o.second) {
+			if(fn_new_pos(i.first) > fn_new_pos(n_winner->first))
+				n_winner = &i;
+		}
+		if(n_winner->first == o.second.back().first)
+			continue;
+		link_op	op;
+		op.sym_path = data_dir;
+		PATHS.append(op.sym_path, o.first);
+		PATHS.append(op.target, n_winner->second);
+		LOG << "Overlay symlink '" << op.sym_path << "' now from '" << op.target << "'";
+		ops.emplace_back(op);
+	}
+	apply_link_ops(ops);
+	// finally move the plugin
+	p_data	p = std::move(PLUGINS_LIST[src]);
+	PLUGINS_LIST.erase(PLUGINS_LIST.begin() + src);
+	PLUGINS_LIST.insert(PLUGINS_LIST.begin() + dst, std::move(p));
+	ostr << utils::term::blue(p_name + " moved " + (after ? "after " : "before ") + tgt_name) << " (" << ops.size() << " symlinks updated)" << std::endl;
 }
 
 bool fso::check_plugin(const std::string& p_name) {
@@ -280,13 +993,134 @@ bool fso::check_plugin(const std::string& p_name) {
 	return false;
 }
 
-void fso::scan_plugin(const std::string& p_name, const std::string& pbase, const std::string& data_dir) {
+void fso::pack_plugin(std::ostream& ostr, const std::string& p_name, const std::string& pbase, const std::string& data_dir, const std::string& ovd_dir, std::vector<std::string>& esp_files, const path_map& staged) {
+	// only the assets not replacing files of other
+	// plugins (loose or in their BSAs) get packed,
+	// those have to stay loose to keep overriding
+	const static std::regex		bsa_regex("\\.bsa$" , std::regex_constants::ECMAScript | std::regex_constants::icase);
+	std::unordered_set<std::string>	owned;
+	std::vector<std::string>	bsa_assets;
+	for(const auto& p : PLUGINS_LIST) {
+		for(const auto& f : p.files) {
+			const auto	r_file = PATHS.str(f.r_file);
+			owned.insert(utils::to_lower(PATHS.str(f.sym_file)));
+			if(!std::regex_search(r_file, bsa_regex))
+				continue;
+			try {
+				bsa::list(r_file, bsa_assets);
+			} catch(const std::exception& e) {
+				LOG << "Can't list BSA '" << r_file << "': " << e.what();
+			}
+		}
+	}
+	owned.insert(bsa_assets.begin(), bsa_assets.end());
+	const static std::regex		asset_regex("^(meshes|textures|sound|interface)/", std::regex_constants::ECMAScript | std::regex_constants::icase);
+	std::vector<bsa::pack_item>	items;
+	std::vector<std::string>	syms;
+	uint64_t			tot_sz = 0;
+	// the files of the install are all staged,
+	// each deployed at the same relative path
+	const std::string		st_data_dir = staged(data_dir),
+					st_pbase = staged(pbase);
+	rec_dir_files(st_pbase, [&](const std::string& rel) -> void {
+		const auto	st_r_file = st_pbase + rel;
+		struct stat	s = {0};
+		if(!std::regex_search(rel, asset_regex) || owned.count(utils::to_lower(rel)) || stat(st_r_file.c_str(), &s) || !s.st_size)
+			return;
+		items.push_back({rel, st_r_file});
+		syms.push_back(st_data_dir + rel);
+		tot_sz += s.st_size;
+	});
+	if(items.empty())
+		return;
+	if(tot_sz > 0x7FFFFFFF) {
+		ostr << utils::term::yellow(std::string("Loose files of '") + p_name + "' exceed 2GB, not packing them into a BSA") << std::endl;
+		return;
+	}
+	// the game loads a BSA named as a plugin, use
+	// the first one of the mod or a dummy one
+	const static std::regex		plugin_regex("\\.es[pml]$", std::regex_constants::ECMAScript | std::regex_constants::icase);
+	std::string			b_name;
+	for(const auto& e : esp_files) {
+		if(e == data_dir + utils::file_name(e) && std::regex_search(e, plugin_regex)) {
+			b_name = utils::file_name(e);
+			b_name = b_name.substr(0, b_name.length()-4);
+			break;
+		}
+	}
+	const bool	dummy_esp = b_name.empty();
+	if(dummy_esp)
+		b_name = p_name.substr(0, p_name.find_last_of('.'));
+	struct stat	s = {0};
+	const auto	exists = [&staged, &s](const std::string& f) -> bool {
+		return !lstat(f.c_str(), &s) || !lstat(staged(f).c_str(), &s);
+	};
+	if(exists(data_dir + b_name + ".bsa") || (dummy_esp && exists(data_dir + b_name + ".esp"))) {
+		ostr << utils::term::yellow(std::string("BSA/plugin '") + b_name + "' already under Data, not packing loose files of '" + p_name + "'") << std::endl;
+		return;
+	}
+	bsa::pack(staged(pbase + b_name + ".bsa"), items);
+	// now replace the loose files with the BSA,
+	// removing the directories left empty
+	const auto	rm_empty_dirs = [](std::string f, const std::string& base) -> void {
+		size_t	p_slash = std::string::npos;
+		while((p_slash = f.find_last_of('/')) != std::string::npos && p_slash > base.length()) {
+			f.resize(p_slash);
+			if(rmdir(f.c_str()))
+				break;
+		}
+	};
+	std::unordered_set<ino_t>	shared;
+	for(size_t i = 0; i < items.size(); ++i) {
+		struct stat	s = {0};
+		if(!lstat(items[i].src.c_str(), &s) && s.st_nlink > 1)
+			shared.insert(s.st_ino);
+		if((utils::deploy_mode::FUSE != DEPLOY_MODE && unlink(syms[i].c_str())) || unlink(items[i].src.c_str()))
+			throw std::runtime_error(std::string("Can't remove packed file '") + items[i].src + "'");
+		rm_empty_dirs(syms[i], st_data_dir);
+		rm_empty_dirs(items[i].src, st_pbase);
+	}
+	// the blobs just added to the store by the
+	// packed files are not needed anymore
+	store::gc(staged(store::dir(ovd_dir)), shared);
+	// only symlinks can point to files not
+	// yet in place
+	const auto		link_target = [&staged](const std::string& f) -> std::string {
+		return (utils::deploy_mode::SYMLINK == DEPLOY_MODE) ? f : staged(f);
+	};
+	std::vector<link_op>	ops;
+	ops.push_back({staged(data_dir + b_name + ".bsa"), link_target(pbase + b_name + ".bsa")});
+	if(dummy_esp) {
+		esp::write_dummy(staged(pbase + b_name + ".esp"));
+		ops.push_back({staged(data_dir + b_name + ".esp"), link_target(pbase + b_name + ".esp")});
+		esp_files.push_back(data_dir + b_name + ".esp");
+	}
+	apply_link_ops(ops);
+	ostr << utils::term::green(std::string("Packed ") + std::to_string(items.size()) + " loose files of '" + p_name + "' into '" + b_name + ".bsa'") << (dummy_esp ? " (with dummy plugin)" : "") << std::endl;
+}
+
+void fso::scan_plugin(const std::string& p_name, const std::string& pbase, const std::string& data_dir, const path_map& staged) {
 	p_data	d;
 	d.p_name = p_name;
-	rec_dir_scan(data_dir, data_dir, pbase, d);
+	// renames on commit keep the fingerprints
+	rec_dir_files(staged(pbase), [&](const std::string& rel) -> void {
+		d.files.push_back({PATHS.intern(pbase + rel), PATHS.intern(rel), fingerprint::of(staged(pbase + rel)), fingerprint::of(staged(data_dir + rel))});
+	});
 	PLUGINS_LIST.emplace_back(d);
 }
 
+bool fso::has_plugins(void) {
+	return !PLUGINS_LIST.empty();
+}
+
+utils::deploy_mode fso::get_deploy_mode(void) {
+	return DEPLOY_MODE;
+}
+
+void fso::set_deploy_mode(const utils::deploy_mode dm) {
+	DEPLOY_MODE = dm;
+}
+
 void fso::update_xml(const std::string& f) {
 	LOG << "Updating fsoverlay config '" << f << "'";
 	std::unique_ptr<xmlDoc, void (*)(xmlDocPtr)>			dp(0, xmlFreeDoc);
@@ -301,13 +1135,26 @@ void fso::update_xml(const std::string& f) {
 	// it's the first one!
 	{
 		xel_w	root(w.get(), N_ROOT_CFG);
+		root.add_attr_txt(A_DEPLOY, utils::deploy_mode_name(DEPLOY_MODE));
 		for(const auto& p : PLUGINS_LIST) {
 			xel_w	plugin(w.get(), N_PLUGIN);
 			plugin.add_attr_txt(A_NAME, p.p_name);
 			for(const auto& e : p.files) {
 				xel_w	entry(w.get(), N_ENTRY);
-				entry.add_attr_txt(A_FSPATH, e.r_file);
-				entry.add_attr_txt(A_DPATH, e.sym_file);
+				entry.add_attr_txt(A_FSPATH, PATHS.str(e.r_file));
+				entry.add_attr_txt(A_DPATH, PATHS.str(e.sym_file));
+				if(e.r_fp.ino)
+					entry.add_attr_txt(A_FSFP, e.r_fp.str());
+				if(e.sym_fp.ino)
+					entry.add_attr_txt(A_DFP, e.sym_fp.str());
+			}
+		}
+		for(const auto& pr : PROFILES) {
+			xel_w	profile(w.get(), N_PROFILE);
+			profile.add_attr_txt(A_NAME, pr.first);
+			for(const auto& n : pr.second) {
+				xel_w	plugin(w.get(), N_PLUGIN);
+				plugin.add_attr_txt(A_NAME, n);
 			}
 		}
 		xmlTextWriterEndDocument(w.get());
@@ -317,3 +1164,67 @@ void fso::update_xml(const std::string& f) {
 		throw std::runtime_error("Can't update xml fsconfig: xmlSaveFileEnc");
 }
 
+
+void fso::resolve(winner_map& out, const std::unordered_set<std::string>* p_names) {
+	out.clear();
+	for(size_t i = 0; i < PLUGINS_LIST.size(); ++i) {
+		if(p_names && p_names->find(PLUGINS_LIST[i].p_name) == p_names->end())
+			continue;
+		for(const auto& s : PLUGINS_LIST[i].files) {
+			auto&	w = out[PATHS.str(s.sym_file)];
+			w.plugin = i;
+			w.r_file = PATHS.str(s.r_file);
+		}
+	}
+}
+
+void fso::reset(void) {
+	// interned paths are kept, those
+	// will be reused if reloading
+	PLUGINS_LIST.clear();
+	PROFILES.clear();
+	LOADED_XML.reset();
+}
+
+void fso::set_profile(const std::string& name, const std::vector<std::string>& p_names) {
+	if(name.empty() || name == DEFAULT_PROFILE || name[0] == '.' || name.find('/') != std::string::npos)
+		throw std::runtime_error(std::string("Invalid profile name '") + name + "'");
+	std::vector<std::string>	prof;
+	for(const auto& n : p_names) {
+		if(!check_plugin(n))
+			throw std::runtime_error(std::string("Can't find plugin '") + n + "' in list of managed plugins");
+		if(std::find(prof.begin(), prof.end(), n) == prof.end())
+			prof.push_back(n);
+	}
+	PROFILES[name] = prof;
+}
+
+std::unordered_set<std::string> fso::get_profile(const std::string& name) {
+	std::unordered_set<std::string>	rv;
+	if(name == DEFAULT_PROFILE) {
+		for(const auto& p : PLUGINS_LIST)
+			rv.insert(p.p_name);
+		return rv;
+	}
+	const auto	it = PROFILES.find(name);
+	if(it == PROFILES.end())
+		throw std::runtime_error(std::string("Can't find profile '") + name + "'");
+	rv.insert(it->second.begin(), it->second.end());
+	return rv;
+}
+
+void fso::list_profiles(std::ostream& ostr, const std::string& active) {
+	ostr << "\t" << utils::term::blue("Profiles:") << "\n";
+	const auto	fn_name = [&active](const std::string& n) -> std::string {
+		return (n == active) ? utils::term::green(n + " (active)") : utils::term::bold(n);
+	};
+	ostr << fn_name(DEFAULT_PROFILE) << "\n\t<all plugins>\n";
+	for(const auto& pr : PROFILES) {
+		ostr << fn_name(pr.first) << '\n';
+		// in overlay order, the one used to deploy
+		for(const auto& p : PLUGINS_LIST) {
+			if(std::find(pr.second.begin(), pr.second.end(), p.p_name) != pr.second.end())
+				ostr << '\t' << p.p_name << '\n';
+		}
+	}
+}
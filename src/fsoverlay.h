@@ -20,18 +20,78 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include "utils.h"
+#include "watch.h"
 
 namespace fso {
+	// resolved view of the overlay: the winning
+	// plugin (index in list order) and its real
+	// file for a given Data relative path
+	struct winner {
+		size_t		plugin;
+		std::string	r_file;
+	};
+
+	typedef std::unordered_map<std::string, winner>	winner_map;
+	// maps a path to the one to be actually used
+	typedef std::function<std::string(const std::string&)>	path_map;
+
 	// static functions to manage the XML
 	// config overlays
+	// loading again the same unchanged config
+	// is a no-op, otherwise it's reloaded
 	extern void load_xml(const std::string& f);
 	extern void list_plugin(std::ostream& ostr);
 	extern void list_replace(std::ostream& ostr);
-	extern void list_verify(std::ostream& ostr, const std::string& data_dir);
-	extern void list_remove(std::ostream& ostr, const std::string& p_name, const std::string& data_dir);
+	// conflicting BSAs are ranked by the load order
+	// of their plugins in plugins_file, when known
+	extern void list_bsa_replace(std::ostream& ostr, const std::string& data_dir, const std::string& plugins_file);
+	// both only check the entries which changed
+	// according to 'dirty', when set; list_verify
+	// returns true if nothing is wrong. With
+	// fp_updated set, files whose fingerprint (dev,
+	// inode, size, mtime) is still the recorded one
+	// are skipped, and the fingerprints of the ones
+	// found correct get updated and counted there
+	extern bool list_verify(std::ostream& ostr, const std::string& data_dir, const watch::dirty_set* dirty = 0, size_t* fp_updated = 0);
+	extern void list_remove(std::ostream& ostr, const std::vector<std::string>& p_names, const std::string& data_dir, const std::string& ovd_dir);
+	extern void redeploy(std::ostream& ostr, const std::string& data_dir, const std::string& ovd_dir, const watch::dirty_set* dirty = 0);
+	extern void move_plugin(std::ostream& ostr, const std::string& p_name, const std::string& tgt_name, const bool after, const std::string& data_dir);
 	extern bool check_plugin(const std::string& p_name);
-	extern void scan_plugin(const std::string& p_name, const std::string& pbase, const std::string& data_dir);
+	extern bool has_plugins(void);
+	// packs the loose assets just installed by plugin
+	// p_name (which don't replace files of other
+	// plugins) into a BSA, adding the dummy plugin
+	// to esp_files when one had to be created; the
+	// install is read and written at the paths
+	// mapped by 'staged' (see stage::install) and
+	// pbase lives under ovd_dir, holding the store
+	extern void pack_plugin(std::ostream& ostr, const std::string& p_name, const std::string& pbase, const std::string& data_dir, const std::string& ovd_dir, std::vector<std::string>& esp_files, const path_map& staged);
+	// adds plugin p_name with all the files found under
+	// pbase (read at the paths mapped by 'staged'), each
+	// deployed from pbase at the same relative path
+	// under data_dir; their fingerprints get recorded
+	extern void scan_plugin(const std::string& p_name, const std::string& pbase, const std::string& data_dir, const path_map& staged);
 	extern void update_xml(const std::string& f);
+	// winners among all the plugins or only
+	// among p_names, when set
+	extern void resolve(winner_map& out, const std::unordered_set<std::string>* p_names = 0);
+	// how the files get deployed into Data for all the
+	// plugins, stored in the overlay config
+	extern utils::deploy_mode get_deploy_mode(void);
+	extern void set_deploy_mode(const utils::deploy_mode dm);
+	extern void reset(void);
+	// profiles are named subsets of the plugins, saved
+	// in the overlay config; DEFAULT_PROFILE stands
+	// for all of them and can't be set
+	const char		DEFAULT_PROFILE[] = "default";
+	extern void set_profile(const std::string& name, const std::vector<std::string>& p_names);
+	extern std::unordered_set<std::string> get_profile(const std::string& name);
+	extern void list_profiles(std::ostream& ostr, const std::string& active);
 }
 
 #endif //_FSOVERLAY_H_
@@ -0,0 +1,267 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "fusefs.h"
+#include "fsoverlay.h"
+#include "utils.h"
+#include <stdexcept>
+
+#ifdef _FUSE
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <set>
+#include <vector>
+#include <unordered_map>
+
+namespace {
+	// each node of the overlay index is either
+	// a file (with its real file) or a directory
+	// (with its children names)
+	struct node {
+		std::string			r_file;
+		std::vector<std::string>	children;
+	};
+
+	// keys are Data relative paths without
+	// leading '/', root being ""
+	typedef std::unordered_map<std::string, node>	index;
+
+	struct state {
+		int				base_fd;
+		std::string			fso_xml;
+		std::mutex			reload_mtx;
+		std::shared_ptr<const index>	idx;
+		struct timespec			xml_mtime;
+		std::atomic<time_t>		last_check;
+	};
+
+	state	ST;
+
+	std::shared_ptr<const index> build_index(void) {
+		fso::winner_map	wm;
+		fso::resolve(wm);
+		auto	idx = std::make_shared<index>();
+		(*idx)[""];
+		for(const auto& w : wm) {
+			(*idx)[w.first].r_file = w.second.r_file;
+			// add all the parent directories, stopping
+			// at the first one already present
+			std::string	cur = w.first;
+			while(!cur.empty()) {
+				const auto		p_slash = cur.find_last_of('/');
+				const std::string	parent = (p_slash == std::string::npos) ? "" : cur.substr(0, p_slash),
+							name = (p_slash == std::string::npos) ? cur : cur.substr(p_slash+1);
+				const auto		it = idx->emplace(parent, node());
+				it.first->second.children.push_back(name);
+				if(!it.second)
+					break;
+				cur = parent;
+			}
+		}
+		LOG << "FUSE overlay index built with " << idx->size() << " entries";
+		return idx;
+	}
+
+	bool get_xml_mtime(struct timespec& ts) {
+		struct stat	st;
+		if(stat(ST.fso_xml.c_str(), &st))
+			return false;
+		ts = st.st_mtim;
+		return true;
+	}
+
+	// at most once per second check if the overlay
+	// config has been updated (i.e. plugins added,
+	// removed or reordered) and in case rebuild
+	// the in-memory index
+	std::shared_ptr<const index> get_index(void) {
+		const time_t	now = time(NULL);
+		if(ST.last_check.exchange(now) != now) {
+			struct timespec	ts = {0, 0};
+			get_xml_mtime(ts);
+			std::lock_guard<std::mutex>	l(ST.reload_mtx);
+			if(ts.tv_sec != ST.xml_mtime.tv_sec || ts.tv_nsec != ST.xml_mtime.tv_nsec) {
+				try {
+					fso::reset();
+					fso::load_xml(ST.fso_xml);
+					std::atomic_store(&ST.idx, build_index());
+					ST.xml_mtime = ts;
+				} catch(const std::exception& e) {
+					LOG << "Can't reload overlay config: " << e.what();
+				}
+			}
+		}
+		return std::atomic_load(&ST.idx);
+	}
+
+	const char* rel_path(const char* path) {
+		// fuse paths always start with '/'
+		return (path[1] == '\0') ? "." : path + 1;
+	}
+
+	const node* find_node(const index& idx, const char* path) {
+		const auto	it = idx.find(path + 1);
+		return (it == idx.end()) ? 0 : &it->second;
+	}
+
+	int fs_getattr(const char* path, struct stat* st, struct fuse_file_info* fi) {
+		const auto	idx = get_index();
+		const auto	n = find_node(*idx, path);
+		int		rv = 0;
+		if(n && !n->r_file.empty()) {
+			rv = stat(n->r_file.c_str(), st);
+		} else {
+			rv = fstatat(ST.base_fd, rel_path(path), st, AT_SYMLINK_NOFOLLOW);
+			// directory only present in the overlay
+			if(rv && n) {
+				std::memset(st, 0, sizeof(*st));
+				st->st_mode = S_IFDIR | 0555;
+				st->st_nlink = 2;
+				rv = 0;
+			}
+		}
+		if(rv)
+			return -errno;
+		st->st_mode &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
+		return 0;
+	}
+
+	int fs_readlink(const char* path, char* buf, size_t sz) {
+		const ssize_t	rv = readlinkat(ST.base_fd, rel_path(path), buf, sz-1);
+		if(rv == -1)
+			return -errno;
+		buf[rv] = '\0';
+		return 0;
+	}
+
+	int fs_open(const char* path, struct fuse_file_info* fi) {
+		if((fi->flags & O_ACCMODE) != O_RDONLY)
+			return -EROFS;
+		const auto	idx = get_index();
+		const auto	n = find_node(*idx, path);
+		const int	fd = (n && !n->r_file.empty()) ? open(n->r_file.c_str(), O_RDONLY) : openat(ST.base_fd, rel_path(path), O_RDONLY);
+		if(fd == -1)
+			return -errno;
+		fi->fh = fd;
+		return 0;
+	}
+
+	int fs_read(const char* path, char* buf, size_t sz, off_t off, struct fuse_file_info* fi) {
+		const ssize_t	rv = pread(fi->fh, buf, sz, off);
+		return (rv == -1) ? -errno : rv;
+	}
+
+	int fs_release(const char* path, struct fuse_file_info* fi) {
+		close(fi->fh);
+		return 0;
+	}
+
+	int fs_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t off, struct fuse_file_info* fi, enum fuse_readdir_flags flags) {
+		const auto		idx = get_index();
+		const auto		n = find_node(*idx, path);
+		std::set<std::string>	names;
+		if(n)
+			names.insert(n->children.begin(), n->children.end());
+		const int		fd = openat(ST.base_fd, rel_path(path), O_RDONLY | O_DIRECTORY);
+		if(fd != -1) {
+			std::unique_ptr<DIR, int(*)(DIR*)>	d(fdopendir(fd), closedir);
+			if(!d) {
+				close(fd);
+			} else {
+				struct dirent	*de = 0;
+				while((de = readdir(d.get()))) {
+					if(!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+						continue;
+					names.insert(de->d_name);
+				}
+			}
+		} else if(!n) {
+			return -errno;
+		}
+		filler(buf, ".", 0, 0, static_cast<fuse_fill_dir_flags>(0));
+		filler(buf, "..", 0, 0, static_cast<fuse_fill_dir_flags>(0));
+		for(const auto& i : names) {
+			if(filler(buf, i.c_str(), 0, 0, static_cast<fuse_fill_dir_flags>(0)))
+				break;
+		}
+		return 0;
+	}
+
+	int fs_access(const char* path, int mask) {
+		return (mask & W_OK) ? -EROFS : 0;
+	}
+}
+
+void fusefs::mount(const std::string& data_dir, const std::string& fso_xml, const std::string& mnt_point) {
+	// keep an handle to the underlying Data directory
+	// so that it's still reachable in case it gets
+	// mounted over
+	ST.base_fd = open(data_dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if(ST.base_fd == -1)
+		throw std::runtime_error(std::string("Can't open Data directory '") + data_dir + "'");
+	ST.fso_xml = std::string("/proc/self/fd/") + std::to_string(ST.base_fd) + '/' + utils::file_name(fso_xml);
+	ST.xml_mtime = {0, 0};
+	get_xml_mtime(ST.xml_mtime);
+	ST.idx = build_index();
+	ST.last_check = time(NULL);
+
+	struct fuse_operations	ops;
+	std::memset(&ops, 0, sizeof(ops));
+	ops.getattr = fs_getattr;
+	ops.readlink = fs_readlink;
+	ops.open = fs_open;
+	ops.read = fs_read;
+	ops.release = fs_release;
+	ops.readdir = fs_readdir;
+	ops.access = fs_access;
+
+	std::string		o_opts("ro,fsname=skyrim-pm,default_permissions");
+	std::vector<char*>	args;
+	args.push_back(const_cast<char*>("skyrim-pm"));
+	args.push_back(const_cast<char*>("-f"));
+	args.push_back(const_cast<char*>("-o"));
+	args.push_back(&o_opts[0]);
+	args.push_back(const_cast<char*>(mnt_point.c_str()));
+	args.push_back(0);
+	LOG << "Mounting FUSE overlay of '" << data_dir << "' on '" << mnt_point << "'";
+	const int	rv = fuse_main(static_cast<int>(args.size()-1), &args[0], &ops, 0);
+	close(ST.base_fd);
+	if(rv)
+		throw std::runtime_error(std::string("FUSE mount on '") + mnt_point + "' failed");
+}
+
+#else
+
+void fusefs::mount(const std::string& data_dir, const std::string& fso_xml, const std::string& mnt_point) {
+	throw std::runtime_error("skyrim-pm has been built without FUSE support (build with 'make FUSE=1')");
+}
+
+#endif //_FUSE
+
@@ -0,0 +1,33 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _FUSEFS_H_
+#define _FUSEFS_H_
+
+#include <string>
+
+namespace fusefs {
+	// mounts at mnt_point a read-only union view of
+	// data_dir and of the overlay config (fso_xml);
+	// overlay files take precedence over data_dir
+	// ones. Blocks until unmounted
+	extern void mount(const std::string& data_dir, const std::string& fso_xml, const std::string& mnt_point);
+}
+
+#endif //_FUSEFS_H_
+
@@ -17,154 +17,449 @@
 
 #include <iostream>
 #include <sstream>
+#include <memory>
 #include <libxml/parser.h>
 #include "modcfg.h"
 #include "utils.h"
 #include "opt.h"
 #include "plugins.h"
 #include "fsoverlay.h"
+#include "fusefs.h"
+#include "answers.h"
+#include "dataidx.h"
+#include "stage.h"
+#include "store.h"
+#include "server.h"
+#include "watch.h"
+#include "profile.h"
 
 namespace {
 	const char	*VERSION = "0.2.0",
 			*FSO_XML = "skyrim-pm-fso.xml";
-}
 
-int main(int argc, char *argv[]) {
-	try {
-		const auto	mod_idx = opt::parse_args(argc, argv, argv[0], VERSION);
-		// setup options and enable
-		if(opt::use_term_style)
-			utils::term::enable();
-		// setup skyrim data dir
-		if(opt::skyrim_se_data.empty()) {
-			LOG << "Skyrim SE Data directory not set, locating it";
-			opt::skyrim_se_data = utils::get_skyrim_se_data();
+	// set when Data, the overlay config or Plugins.txt
+	// get modified, for the server to refresh its state
+	bool				STATE_CHANGED = false;
+	// index of Data/Plugins.txt, kept warm by the server
+	std::unique_ptr<dataidx::index>	DIDX;
+
+	dataidx::index& warm_didx(const std::string& data_dir, const std::string& plugins_file) {
+		if(!DIDX || DIDX->data_dir() != data_dir || DIDX->plugins_file() != plugins_file)
+			DIDX.reset(new dataidx::index(data_dir, plugins_file));
+		return *DIDX;
+	}
+
+	// Plugins.txt as found with --auto-plugins, the
+	// requests of the server don't look for it again
+	std::string			AUTO_PLUGINS;
+
+	// set when the overlay was found correctly deployed
+	bool				STATE_SYNCED = false;
+	// changes to Data and the override directory, as
+	// tracked by the server; the requests it serves
+	// are forked right after reading the pending
+	// events, other processes can't know what the
+	// server has yet to read and don't get those
+	std::unique_ptr<watch::dirty_set>	DIRTY;
+
+	// the changes apply to the same directories only,
+	// without any everything has to be checked
+	const watch::dirty_set* get_dirty(const std::string& data_dir, const std::string& ovd_dir) {
+		if(!DIRTY || DIRTY->roots() != std::vector<std::string>{ data_dir, ovd_dir })
+			return 0;
+		return DIRTY.get();
+	}
+
+	int run(int argc, char *argv[]) {
+		try {
+			const auto	mod_idx = opt::parse_args(argc, argv, argv[0], VERSION);
+			const auto	sock = opt::server_socket.empty() ? server::default_socket() : opt::server_socket;
+			// the server runs the request
+			if(opt::server_remote)
+				return server::forward(sock, argc, argv);
+			// setup options and enable
+			utils::term::enable(opt::use_term_style);
+			// setup skyrim data dir
 			if(opt::skyrim_se_data.empty()) {
-				LOG << "Skyrim SE Data directory not found, defaulting to './Data'";
-				std::cout << utils::term::yellow(
-						"Warning, can't find Skyrim SE install directory "
-						"(i.e. 'Skyrim Special Edition'), ensure skyrim-pm "
-						"is running from there") << std::endl;
-				opt::skyrim_se_data = "./Data";
-			} else {
-				LOG << "Skyrim SE Data directory found at '" << opt::skyrim_se_data << "'";
+				LOG << "Skyrim SE Data directory not set, locating it";
+				opt::skyrim_se_data = utils::get_skyrim_se_data();
+				if(opt::skyrim_se_data.empty()) {
+					LOG << "Skyrim SE Data directory not found, defaulting to './Data'";
+					std::cout << utils::term::yellow(
+							"Warning, can't find Skyrim SE install directory "
+							"(i.e. 'Skyrim Special Edition'), ensure skyrim-pm "
+							"is running from there") << std::endl;
+					opt::skyrim_se_data = "./Data";
+				} else {
+					LOG << "Skyrim SE Data directory found at '" << opt::skyrim_se_data << "'";
+				}
 			}
-		}
-		// setup the plugins file
-		if(opt::auto_plugins && opt::skyrim_se_plugins.empty()) {
-			LOG << "Skyrim SE Plugins.txt not set, locating it";
-			opt::skyrim_se_plugins = utils::get_skyrim_se_plugins();
-			if(opt::skyrim_se_plugins.empty())
-				throw std::runtime_error("Can't automatically find 'Plugins.txt', please specify it manually");
-			else {
-				LOG << "Skyrim SE Plugins.txt found at '" << opt::skyrim_se_plugins << "'";
-			}
-		} else if (opt::auto_plugins && !opt::skyrim_se_plugins.empty()) {
-			throw std::runtime_error("Both 'Plugins.txt' file and automated search for the same have been specified, please set one only option");
-		}
-		// ensure the path folders are '/' terminated
-		// and properly formatted (override_data is
-		// absolute)
-		std::string	FSO_XML_PATH;
-		if(*opt::skyrim_se_data.rbegin() != '/')
-			opt::skyrim_se_data += '/';
-		if(!opt::override_data.empty()) {
-			if(*opt::override_data.rbegin() != '/')
-				opt::override_data += '/';
-			if(*opt::override_data.begin() != '/') {
-				// if starting is './', remove it...
-				if(opt::override_data.length() > 2 && (0==opt::override_data.find("./")))
-					opt::override_data = opt::override_data.substr(2);
+			// setup the plugins file
+			if(opt::auto_plugins && !AUTO_PLUGINS.empty() && opt::skyrim_se_plugins == AUTO_PLUGINS) {
+				LOG << "Skyrim SE Plugins.txt already found at '" << opt::skyrim_se_plugins << "'";
+			} else if(opt::auto_plugins && opt::skyrim_se_plugins.empty()) {
+				LOG << "Skyrim SE Plugins.txt not set, locating it";
+				opt::skyrim_se_plugins = utils::get_skyrim_se_plugins();
+				if(opt::skyrim_se_plugins.empty())
+					throw std::runtime_error("Can't automatically find 'Plugins.txt', please specify it manually");
+				else {
+					LOG << "Skyrim SE Plugins.txt found at '" << opt::skyrim_se_plugins << "'";
+					AUTO_PLUGINS = opt::skyrim_se_plugins;
+				}
+			} else if (opt::auto_plugins && !opt::skyrim_se_plugins.empty()) {
+				throw std::runtime_error("Both 'Plugins.txt' file and automated search for the same have been specified, please set one only option");
+			}
+			// setup the answers file
+			if(!opt::answers_record.empty() && !opt::answers_replay.empty())
+				throw std::runtime_error("Both recording and replaying of answers have been specified, please set one only option");
+			answers::file	ans;
+			const bool	ans_replay = !opt::answers_replay.empty();
+			const auto&	ans_file = ans_replay ? opt::answers_replay : opt::answers_record;
+			if(!ans_file.empty()) {
+				ans.load(ans_file, ans_replay);
+			}
+			// ensure the path folders are '/' terminated
+			// and properly formatted (override_data is
+			// absolute)
+			std::string	FSO_XML_PATH;
+			if(*opt::skyrim_se_data.rbegin() != '/')
+				opt::skyrim_se_data += '/';
+			if(!opt::override_data.empty()) {
+				if(*opt::override_data.rbegin() != '/')
+					opt::override_data += '/';
+				if(*opt::override_data.begin() != '/') {
+					// if starting is './', remove it...
+					if(opt::override_data.length() > 2 && (0==opt::override_data.find("./")))
+						opt::override_data = opt::override_data.substr(2);
 
-				char	cwd[PATH_MAX];
-				if(!getcwd(cwd, PATH_MAX))
-					throw std::runtime_error("Can't get current directory");
-				opt::override_data = std::string(cwd) + '/' + opt::override_data;
-				LOG << "override_data path supplied not absolute, defaulted to '" << opt::override_data << "'";
-			}
-			FSO_XML_PATH = opt::skyrim_se_data + FSO_XML;
-			// setup the plugins
-			fso::load_xml(FSO_XML_PATH);
-		}
-		// in case we're listing overrides, do it an exit
-		if(opt::override_list) {
-			if(opt::override_data.empty())
-				throw std::runtime_error("'override' directory not provided, can't list as such");
-			fso::list_plugin(std::cout);
-			return 0;
-		}
-		if(opt::override_list_replace) {
-			if(opt::override_data.empty())
-				throw std::runtime_error("'override' directory not provided, can't list as such");
-			fso::list_replace(std::cout);
-			return 0;
-		}
-		if(opt::override_list_verify) {
-			if(opt::override_data.empty())
-				throw std::runtime_error("'override' directory not provided, can't list as such");
-			fso::list_verify(std::cout, opt::skyrim_se_data);
-			return 0;
-		}
-		// for all the mod files...
-		for(int i = mod_idx; i < argc; ++i) {
-			const auto	plugin_name = utils::file_name(argv[i]);
-			// in case we're in remove mode, try to do it
+					char	cwd[PATH_MAX];
+					if(!getcwd(cwd, PATH_MAX))
+						throw std::runtime_error("Can't get current directory");
+					opt::override_data = std::string(cwd) + '/' + opt::override_data;
+					LOG << "override_data path supplied not absolute, defaulted to '" << opt::override_data << "'";
+				}
+				// with profiles, in the directory of the default one
+				FSO_XML_PATH = profile::base_dir(opt::skyrim_se_data) + FSO_XML;
+				// setup the plugins
+				fso::load_xml(FSO_XML_PATH);
+			}
+			if(opt::override_pack_bsa && opt::override_data.empty())
+				throw std::runtime_error("'override' directory not provided, can't pack BSAs");
+			if(opt::override_dedup_store && opt::override_data.empty())
+				throw std::runtime_error("'override' directory not provided, can't use the store");
+			// the deploy mode is stored in the override config,
+			// changing it means relinking all the files
+			bool	deploy_mode_changed = false;
+			if(!opt::override_deploy_mode.empty()) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't set deploy mode");
+				const auto	dm = utils::parse_deploy_mode(opt::override_deploy_mode);
+				deploy_mode_changed = (dm != fso::get_deploy_mode());
+				if(deploy_mode_changed && fso::has_plugins() && !opt::override_redeploy)
+					throw std::runtime_error(std::string("Plugins already deployed as ") + utils::deploy_mode_name(fso::get_deploy_mode()) + "s, use --redeploy to switch deploy mode");
+				fso::set_deploy_mode(dm);
+				if(deploy_mode_changed)
+					utils::probe_deploy_mode(opt::override_data, opt::skyrim_se_data, dm);
+			}
+			// Plugins.txt gets updated once at the end
+			std::unique_ptr<plugins::manager>	pm;
+			if(!opt::skyrim_se_plugins.empty())
+				pm.reset(new plugins::manager(opt::skyrim_se_plugins));
+			if(opt::sort_plugins) {
+				if(!pm)
+					throw std::runtime_error("'Plugins.txt' file not provided, can't sort the load order");
+				STATE_CHANGED = true;
+				pm->sort_load_order(opt::skyrim_se_data);
+			}
+			// index of Data/Plugins.txt, only built if needed
+			dataidx::index&	didx = warm_didx(opt::skyrim_se_data, opt::skyrim_se_plugins);
+			// keep the overlay config and the index loaded
+			// and serve the requests from there
+			if(opt::server_daemon) {
+				didx.load();
+				// the requests only run their own actions and
+				// get Plugins.txt as found, as if set with -p
+				opt::clear_actions();
+				opt::auto_plugins = false;
+				// track what changes under Data and the override
+				// directory, for the requests to check that only;
+				// the events are read at least once a second and
+				// right before each request
+				std::unique_ptr<watch::tracker>		wt;
+				server::poll_fd				wt_fd = { -1, nullptr };
+				uint64_t				req_gen = 0;
+				std::string				w_base;
+				// Data is watched where its content is, which
+				// moves when profiles start being used; serve()
+				// polls the new fd from the next iteration. If
+				// the new watches can't be set (i.e. EMFILE) the
+				// old ones are kept, with everything to check
+				const auto	track = [&]() {
+					const auto				base = profile::base_dir(opt::skyrim_se_data);
+					std::unique_ptr<watch::dirty_set>	ds(new watch::dirty_set({ opt::skyrim_se_data, opt::override_data }));
+					std::unique_ptr<watch::tracker>		t;
+					try {
+						t.reset(new watch::tracker(*ds, { base, opt::override_data }));
+					} catch(...) {
+						if(DIRTY)
+							DIRTY->set_lost();
+						throw;
+					}
+					wt.reset();
+					DIRTY = std::move(ds);
+					wt = std::move(t);
+					w_base = base;
+					wt_fd.fd = wt->fd();
+				};
+				if(!opt::override_data.empty()) {
+					track();
+					wt_fd.on_ready = [&](const bool request) {
+						wt->drain();
+						if(request)
+							req_gen = DIRTY->generation();
+					};
+				}
+				server::serve(sock, [](int argc, char *argv[], server::outcome& out) -> int {
+					opt::server_daemon = false;
+					const int	rv = run(argc, argv);
+					out.changed = STATE_CHANGED;
+					out.synced = STATE_SYNCED;
+					return rv;
+				}, [&](const server::outcome& out) {
+					// a new tracker starts with all paths changed,
+					// the config moves anyway; without one it's
+					// retried after the next change
+					bool		moved = false;
+					const auto	base = profile::base_dir(opt::skyrim_se_data);
+					if(out.changed && wt && base != w_base) {
+						FSO_XML_PATH = base + FSO_XML;
+						moved = true;
+						try {
+							track();
+							LOG << "Data content moved to '" << w_base << "', watches reset";
+						} catch(const std::exception& e) {
+							std::cerr << utils::term::yellow(std::string("Can't watch '") + base + "', all the entries get checked [" + e.what() + "]") << std::endl;
+						}
+					}
+					if(out.changed) {
+						if(!FSO_XML_PATH.empty())
+							fso::load_xml(FSO_XML_PATH);
+						DIDX.reset();
+						warm_didx(opt::skyrim_se_data, opt::skyrim_se_plugins).load();
+					}
+					// what changed up to the request got checked,
+					// what it changed itself is checked next time
+					if(out.synced && wt && !moved) {
+						wt->drain();
+						DIRTY->clear(req_gen);
+					}
+				}, wt_fd);
+				return 0;
+			}
+			// in case we're listing overrides, do it an exit
+			if(opt::override_list) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't list as such");
+				fso::list_plugin(std::cout);
+				return 0;
+			}
+			if(opt::override_list_replace) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't list as such");
+				fso::list_replace(std::cout);
+				return 0;
+			}
+			if(opt::override_list_bsa_replace) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't list as such");
+				fso::list_bsa_replace(std::cout, opt::skyrim_se_data, opt::skyrim_se_plugins);
+				return 0;
+			}
+			if(opt::profile_list) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't list profiles");
+				const auto	active = profile::active(opt::skyrim_se_data);
+				fso::list_profiles(std::cout, active.empty() ? fso::DEFAULT_PROFILE : active);
+				return 0;
+			}
+			// Data has to be the default profile to check
+			// or change the deployed files
+			{
+				const auto	active = profile::active(opt::skyrim_se_data);
+				if(!active.empty() && active != fso::DEFAULT_PROFILE && opt::profile_set.empty() && opt::profile_use.empty())
+					throw std::runtime_error(std::string("Profile '") + active + "' is active, switch back with --profile-use " + fso::DEFAULT_PROFILE + " first");
+			}
+			if(opt::override_list_verify || opt::override_list_verify_fast) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't list as such");
+				size_t	fp_updated = 0;
+				if(fso::list_verify(std::cout, opt::skyrim_se_data, get_dirty(opt::skyrim_se_data, opt::override_data), opt::override_list_verify_fast ? &fp_updated : 0))
+					STATE_SYNCED = true;
+				// save the new fingerprints for the next time
+				if(fp_updated) {
+					LOG << "Updated " << fp_updated << " fingerprints";
+					STATE_CHANGED = true;
+					fso::update_xml(FSO_XML_PATH);
+				}
+				return 0;
+			}
+			// from here on everything modifies the state
+			STATE_CHANGED = true;
+			// profiles are built from the overlay config
+			if(!opt::profile_set.empty() || !opt::profile_use.empty()) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't manage profiles");
+				if(!opt::profile_set.empty()) {
+					std::vector<std::string>	p_names;
+					for(int i = mod_idx; i < argc; ++i)
+						p_names.push_back(utils::file_name(argv[i]));
+					fso::set_profile(opt::profile_set, p_names);
+					fso::update_xml(FSO_XML_PATH);
+					profile::init(std::cout, opt::skyrim_se_data);
+					profile::build(std::cout, opt::skyrim_se_data, opt::profile_set);
+				}
+				if(!opt::profile_use.empty()) {
+					fso::get_profile(opt::profile_use);
+					profile::init(std::cout, opt::skyrim_se_data);
+					profile::build(std::cout, opt::skyrim_se_data, opt::profile_use);
+					profile::activate(std::cout, opt::skyrim_se_data, opt::profile_use);
+				}
+				return 0;
+			}
+			if(opt::override_redeploy) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't redeploy");
+				// switching deploy mode relinks everything
+				fso::redeploy(std::cout, opt::skyrim_se_data, opt::override_data, deploy_mode_changed ? 0 : get_dirty(opt::skyrim_se_data, opt::override_data));
+				if(deploy_mode_changed)
+					fso::update_xml(FSO_XML_PATH);
+				STATE_SYNCED = true;
+				return 0;
+			}
+			if(!opt::override_move.empty()) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't move plugins");
+				if(opt::override_move_tgt.empty())
+					throw std::runtime_error("--move requires either --before or --after");
+				fso::move_plugin(std::cout, opt::override_move, opt::override_move_tgt, opt::override_move_after, opt::skyrim_se_data);
+				fso::update_xml(FSO_XML_PATH);
+				return 0;
+			}
+			if(!opt::fuse_mount.empty()) {
+				if(opt::override_data.empty())
+					throw std::runtime_error("'override' directory not provided, can't mount overlay");
+				fusefs::mount(opt::skyrim_se_data, FSO_XML_PATH, opt::fuse_mount);
+				return 0;
+			}
+			// in case we're in remove mode, remove all
+			// the plugins in one go
 			if(opt::override_list_remove) {
-				LOG << "Trying to remove '" << plugin_name << "'";
 				if(opt::override_data.empty())
 					throw std::runtime_error("Can't run in remove mode without override specified");
-				fso::list_remove(std::cout, plugin_name, opt::skyrim_se_data);
-				continue;
-			}
-			// in case we have override data
-			// check plugin is not already setup
-			if(!opt::override_data.empty() && fso::check_plugin(plugin_name)) {
-				std::stringstream	sstr;
-				sstr	<< "Warning: plugin '" << plugin_name << "' already exists "
-					<< "in list of managed plugins, skipping it";
-				std::cout << utils::term::yellow(sstr.str()) << std::endl;
-				continue;
-			}
-			// open archive
-			arc::file		a(argv[i]);
-			arc::file_names		esp_files;
-			// get and load the ModuleConfig.xml file
-			std::stringstream	sstr;
-			const std::string	ovd = (opt::override_data.empty()) ? "" : opt::override_data + plugin_name + '/';
-			if(!a.extract_modcfg(sstr)) {
-				if(opt::data_extract) {
-					std::stringstream	msg;
-					msg	<< "Can't find/extract ModuleConfig.xml from archive '"
-						<< argv[i] << "', proceeding with raw data extraction";
-					std::cout << utils::term::yellow(msg.str()) << std::endl;
-					a.extract_data(opt::skyrim_se_data, ovd, &esp_files);
-				} else throw std::runtime_error(std::string("Can't find/extract ModuleConfig.xml from archive '") + argv[i] + "'");
-			} else {
-				// parse the XML
-				modcfg::parser		mcp(sstr.str());
-				if(opt::xml_debug)
-					mcp.print_tree(std::cout);
-				// execute it
-				mcp.execute(std::cout, std::cin, a, { opt::skyrim_se_data, ovd, &esp_files });
-			}
-			// manage ESP list
-			if(!opt::skyrim_se_plugins.empty()) {
-				plugins::add_esp_files(esp_files, opt::skyrim_se_data, opt::skyrim_se_plugins);
-			}
-			// add to fso in case
-			if(!ovd.empty()) {
-				fso::scan_plugin(plugin_name, ovd, opt::skyrim_se_data);
+				std::vector<std::string>	p_names;
+				for(int i = mod_idx; i < argc; ++i) {
+					p_names.push_back(utils::file_name(argv[i]));
+					LOG << "Trying to remove '" << p_names.back() << "'";
+				}
+				fso::list_remove(std::cout, p_names, opt::skyrim_se_data, opt::override_data);
+				fso::update_xml(FSO_XML_PATH);
 			}
+			// each install is committed on its own,
+			// on failure keep Plugins.txt in sync with
+			// the ones already done
+			try {
+				// for all the mod files...
+				for(int i = mod_idx; !opt::override_list_remove && i < argc; ++i) {
+					const auto	plugin_name = utils::file_name(argv[i]);
+					// in case we have override data
+					// check plugin is not already setup
+					if(!opt::override_data.empty() && fso::check_plugin(plugin_name)) {
+						std::stringstream	sstr;
+						sstr	<< "Warning: plugin '" << plugin_name << "' already exists "
+							<< "in list of managed plugins, skipping it";
+						std::cout << utils::term::yellow(sstr.str()) << std::endl;
+						continue;
+					}
+					// open archive
+					arc::file		a(argv[i]);
+					arc::file_names		esp_files;
+					// get and load the ModuleConfig.xml file
+					std::stringstream	sstr;
+					const std::string	ovd = (opt::override_data.empty()) ? "" : opt::override_data + plugin_name + '/';
+					// everything gets written to a staging tree
+					// first, Data is only touched on commit
+					stage::install		st(opt::skyrim_se_data, opt::override_data);
+					const auto		staged = [&st](const std::string& p) { return st.staged(p); };
+					a.set_stage(staged);
+					a.set_deploy_mode(fso::get_deploy_mode());
+					if(opt::override_dedup_store)
+						a.set_store(store::dir(opt::override_data), st.staged(store::dir(opt::override_data)));
+					if(!a.extract_modcfg(sstr)) {
+						if(opt::data_extract) {
+							std::stringstream	msg;
+							msg	<< "Can't find/extract ModuleConfig.xml from archive '"
+								<< argv[i] << "', proceeding with raw data extraction";
+							std::cout << utils::term::yellow(msg.str()) << std::endl;
+							a.extract_data(opt::skyrim_se_data, ovd, &esp_files, [&didx](const std::string& f) { return didx.cased(f); });
+						} else throw std::runtime_error(std::string("Can't find/extract ModuleConfig.xml from archive '") + argv[i] + "'");
+					} else {
+						// parse the XML
+						modcfg::parser		mcp(sstr.str());
+						if(opt::xml_debug)
+							mcp.print_tree(std::cout);
+						// execute it
+						mcp.execute(std::cout, std::cin, a, { opt::skyrim_se_data, ovd, &esp_files, ans_file.empty() ? 0 : &ans, ans_replay, &didx });
+						// save recorded answers as we go
+						if(!opt::answers_record.empty())
+							ans.save(opt::answers_record);
+					}
+					// pack the loose files in case
+					if(opt::override_pack_bsa && !ovd.empty()) {
+						fso::pack_plugin(std::cout, plugin_name, ovd, opt::skyrim_se_data, opt::override_data, esp_files, staged);
+					}
+					// add to fso in case, the overlay config is
+					// swapped in with the same commit
+					if(!ovd.empty()) {
+						fso::scan_plugin(plugin_name, ovd, opt::skyrim_se_data, staged);
+						fso::update_xml(FSO_XML_PATH + ".tmp");
+						st.commit(FSO_XML_PATH + ".tmp", FSO_XML_PATH);
+					} else {
+						st.commit();
+					}
+					// keep the index updated for the next plugins
+					for(const auto& e : esp_files) {
+						if(e.find(opt::skyrim_se_data) != 0)
+							continue;
+						didx.add_file(e.substr(opt::skyrim_se_data.length()));
+						if(!opt::skyrim_se_plugins.empty())
+							didx.set_active(e.substr(opt::skyrim_se_data.length()));
+					}
+					// manage ESP list
+					if(pm) {
+						pm->add_esp_files(esp_files, opt::skyrim_se_data);
+					}
+				}
+			} catch(...) {
+				if(pm)
+					pm->commit();
+				throw;
+			}
+			if(pm) {
+				pm->commit();
+			}
+			// cleanup the xml2 library structures
+			xmlCleanupParser();
+		} catch(const std::exception& e) {
+			std::cerr << utils::term::dim("Exception: ") << utils::term::red(e.what()) << std::endl;
+			return 1;
+		} catch(...) {
+			std::cerr << utils::term::red("Unknown exception") << std::endl;
+			return 1;
 		}
-		// in case we have overrides, update xml
-		if(!opt::override_data.empty()) {
-			fso::update_xml(FSO_XML_PATH);
-		}
-		// cleanup the xml2 library structures
-		xmlCleanupParser();
-	} catch(const std::exception& e) {
-		std::cerr << utils::term::dim("Exception: ") << utils::term::red(e.what()) << std::endl;
-	} catch(...) {
-		std::cerr << utils::term::red("Unknown exception") << std::endl;
+		return 0;
 	}
 }
+
+int main(int argc, char *argv[]) {
+	return run(argc, argv);
+}
@@ -15,15 +15,360 @@
     along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
  * */
 
+
 #include "modcfg.h"
 #include <istream>
 #include <ostream>
 #include <sstream>
+#include <cstring>
+#include <unordered_map>
 
 namespace {
-	typedef utils::XmlCharHolder xc;
+	typedef utils::XmlCharHolder	xc;
+	typedef modcfg::module_ir	ir_t;
+
+	bool is_elem(const xmlNode* n, const char* name) {
+		return (n->type == XML_ELEMENT_NODE) && !std::strcmp((const char*)n->name, name);
+	}
+
+	// compiles once the libxml2 tree of a
+	// ModuleConfig into a module_ir
+	class compiler {
+		ir_t&						ir_;
+		std::unordered_map<std::string, uint32_t>	flag_names_,
+								flag_values_;
+
+		static uint32_t intern(const std::string& s, std::unordered_map<std::string, uint32_t>& idx, std::vector<std::string>& v) {
+			const auto	it = idx.find(s);
+			if(it != idx.end())
+				return it->second;
+			const uint32_t	id = v.size();
+			v.push_back(s);
+			idx[s] = id;
+			return id;
+		}
+
+		uint32_t flag_name(const char* s) {
+			return intern(s, flag_names_, ir_.flag_names);
+		}
+
+		uint32_t flag_value(const char* s) {
+			return intern(s, flag_values_, ir_.flag_values);
+		}
+
+		static ir_t::plugin_type get_type(xmlNode* n) {
+			const xc	x_name(xmlGetProp(n, (const xmlChar*)"name"));
+			if(!x_name)
+				return ir_t::T_OPTIONAL;
+			if(!std::strcmp(x_name.c_str(), "Required"))
+				return ir_t::T_REQUIRED;
+			if(!std::strcmp(x_name.c_str(), "Recommended"))
+				return ir_t::T_RECOMMENDED;
+			if(!std::strcmp(x_name.c_str(), "NotUsable"))
+				return ir_t::T_NOT_USABLE;
+			if(!std::strcmp(x_name.c_str(), "CouldBeUsable"))
+				return ir_t::T_COULD_BE_USABLE;
+			return ir_t::T_OPTIONAL;
+		}
+
+		ir_t::range ops(xmlNode* node) {
+			ir_t::range	rv = { static_cast<uint32_t>(ir_.ops.size()), 0 };
+			for (auto cur_node = node; cur_node; cur_node = cur_node->next) {
+				const bool	is_folder = is_elem(cur_node, "folder");
+				if(!is_folder && !is_elem(cur_node, "file"))
+					continue;
+				const xc		x_src(xmlGetProp(cur_node, (const xmlChar*)"source")),
+							x_dst(xmlGetProp(cur_node, (const xmlChar*)"destination"));
+				if(!x_src)
+					throw std::runtime_error("Invalid ModuleConfig section, 'source' missing");
+				const xc		x_priority(xmlGetProp(cur_node, (const xmlChar*)"priority"));
+				ir_t::op		o;
+				o.is_folder = is_folder;
+				o.src = utils::path2unix((const char*)x_src);
+				o.dst = utils::path2unix((x_dst) ? (const char*)x_dst : "");
+				o.priority = (x_priority) ? std::atoi(x_priority.c_str()) : 0;
+				if(is_folder) {
+					if(!o.dst.empty() && *o.dst.rbegin() != '/')
+						o.dst += '/';
+				} else if(o.dst.empty()) {
+					// in case dst is empty the file goes
+					// directly under 'Data' with its name
+					const auto	p_slash = o.src.find_last_of('/');
+					o.dst = o.src.substr((p_slash == std::string::npos) ? 0 : p_slash+1);
+				}
+				ir_.ops.emplace_back(o);
+			}
+			rv.end = ir_.ops.size();
+			return rv;
+		}
+
+		// compiles all the dependencies among the siblings
+		// starting at node into a single cond node
+		uint32_t deps(xmlNode* node, const ir_t::cond_type type) {
+			std::vector<uint32_t>	children;
+			for(auto fd_node = node; fd_node; fd_node = fd_node->next) {
+				if(fd_node->type != XML_ELEMENT_NODE)
+					continue;
+				ir_t::cond	c;
+				c.id = c.value = ir_t::NONE;
+				c.children = { 0, 0 };
+				if(is_elem(fd_node, "flagDependency")) {
+					const xc	x_flag(xmlGetProp(fd_node, (const xmlChar*)"flag")),
+							x_value(xmlGetProp(fd_node, (const xmlChar*)"value"));
+					if(!x_flag)
+						throw std::runtime_error("Malformed 'flagDependency' section - 'flag' missing");
+					c.type = ir_t::C_FLAG;
+					c.id = flag_name(x_flag.c_str());
+					c.value = x_value ? flag_value(x_value.c_str()) : ir_t::NONE;
+				} else if(is_elem(fd_node, "fileDependency")) {
+					const xc	x_file(xmlGetProp(fd_node, (const xmlChar*)"file")),
+							x_state(xmlGetProp(fd_node, (const xmlChar*)"state"));
+					if(!x_file || !x_state)
+						throw std::runtime_error("Malformed 'fileDependency' section - 'file' and/or 'state' missing");
+					c.type = ir_t::C_FILE;
+					c.id = ir_.file_deps.size();
+					ir_.file_deps.push_back(utils::path2unix(x_file.c_str()));
+					if(!std::strcmp(x_state.c_str(), "Active")) {
+						c.value = dataidx::index::file_state::ACTIVE;
+					} else if(!std::strcmp(x_state.c_str(), "Inactive")) {
+						c.value = dataidx::index::file_state::INACTIVE;
+					} else if(!std::strcmp(x_state.c_str(), "Missing")) {
+						c.value = dataidx::index::file_state::MISSING;
+					} else {
+						throw std::runtime_error(std::string("Malformed 'fileDependency' section - invalid state '") + x_state.c_str() + "'");
+					}
+				} else if(is_elem(fd_node, "gameDependency") || is_elem(fd_node, "fommDependency") || is_elem(fd_node, "foseDependency")) {
+					// game and mod manager versions can't be
+					// checked, assume those are satisfied
+					LOG << "'" << (const char*)fd_node->name << "' assumed to be satisfied";
+					c.type = ir_t::C_TRUE;
+				} else if(is_elem(fd_node, "dependencies")) {
+					children.push_back(deps_node(fd_node));
+					continue;
+				} else {
+					continue;
+				}
+				children.push_back(ir_.conds.size());
+				ir_.conds.emplace_back(c);
+			}
+			ir_t::cond	c;
+			c.type = type;
+			c.id = c.value = ir_t::NONE;
+			c.children.begin = ir_.cond_children.size();
+			ir_.cond_children.insert(ir_.cond_children.end(), children.begin(), children.end());
+			c.children.end = ir_.cond_children.size();
+			ir_.conds.emplace_back(c);
+			return ir_.conds.size()-1;
+		}
+
+		// 'dependencies' node with its optional 'operator'
+		uint32_t deps_node(xmlNode* deps_node) {
+			// default enforce all dependencies to be checked
+			// only use 'Or' if set as such
+			const xc	op_mode(xmlGetProp(deps_node, (const xmlChar*)"operator"));
+			return deps(deps_node->children, (op_mode && !std::strcmp("Or", op_mode.c_str())) ? ir_t::C_OR : ir_t::C_AND);
+		}
+
+		void type_descriptor(xmlNode* td_node, ir_t::plugin& p) {
+			// the type is either set directly in 'type' or
+			// depends on flags in 'dependencyType'
+			p.type_patterns.begin = p.type_patterns.end = ir_.type_patterns.size();
+			for (auto cur_node = td_node->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "type")) {
+					p.def_type = get_type(cur_node);
+				} else if(is_elem(cur_node, "dependencyType")) {
+					for (auto dt_node = cur_node->children; dt_node; dt_node = dt_node->next) {
+						if(is_elem(dt_node, "defaultType")) {
+							p.def_type = get_type(dt_node);
+						} else if(is_elem(dt_node, "patterns")) {
+							for (auto ptn_node = dt_node->children; ptn_node; ptn_node = ptn_node->next) {
+								if(!is_elem(ptn_node, "pattern"))
+									continue;
+								xmlNode	*d = 0,
+									*t = 0;
+								for (auto p_node = ptn_node->children; p_node; p_node = p_node->next) {
+									if(is_elem(p_node, "dependencies"))
+										d = p_node;
+									else if(is_elem(p_node, "type"))
+										t = p_node;
+								}
+								if(!d || !t)
+									continue;
+								ir_.type_patterns.push_back({deps_node(d), get_type(t)});
+							}
+						}
+					}
+				}
+			}
+			p.type_patterns.end = ir_.type_patterns.size();
+		}
+
+		void plugin(xmlNode* plugin_node) {
+			const xc		x_name(xmlGetProp(plugin_node, (const xmlChar*)"name"));
+			if(!x_name)
+				throw std::runtime_error("Invalid plugin, 'name' attribute missing");
+			ir_t::plugin	p;
+			p.name = (const char*)x_name;
+			p.ops = p.flags = p.type_patterns = { 0, 0 };
+			p.def_type = ir_t::T_OPTIONAL;
+			for (auto cur_node = plugin_node->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "files")) {
+					p.ops = ops(cur_node->children);
+				} else if(is_elem(cur_node, "conditionFlags")) {
+					p.flags.begin = ir_.flag_sets.size();
+					for (auto f_node = cur_node->children; f_node; f_node = f_node->next) {
+						if(!is_elem(f_node, "flag"))
+							continue;
+						// we must have name... and possibly the value
+						const xc		x_flag(xmlGetProp(f_node, (const xmlChar*)"name"));
+						if(!x_flag)
+							throw std::runtime_error("Invalid plugin, flag 'name' attribute missing");
+						const xc		value(xmlNodeGetContent(f_node));
+						ir_.flag_sets.push_back({flag_name(x_flag.c_str()), flag_value(value ? value.c_str() : "")});
+					}
+					p.flags.end = ir_.flag_sets.size();
+				} else if(is_elem(cur_node, "typeDescriptor")) {
+					type_descriptor(cur_node, p);
+				}
+			}
+			ir_.plugins.emplace_back(p);
+		}
+
+		void group(xmlNode* group_node) {
+			const xc		x_name(xmlGetProp(group_node, (const xmlChar*)"name")),
+						x_type(xmlGetProp(group_node, (const xmlChar*)"type"));
+			if(!x_type)
+				throw std::runtime_error("Invalid group, 'type' attribute missing");
+			ir_t::group	g;
+			g.name = (x_name) ? (const char*)x_name : "<no name>";
+			const char	*type = x_type.c_str();
+			if(!std::strcmp(type, "SelectExactlyOne")) {
+				g.mode = utils::prompt_choice_mode::ONE_ONLY;
+			} else if(!std::strcmp(type, "SelectAtMostOne")) {
+				g.mode = utils::prompt_choice_mode::ONE_OR_NONE;
+			} else if(!std::strcmp(type, "SelectAny")) {
+				g.mode = utils::prompt_choice_mode::ANY;
+			} else if(!std::strcmp(type, "SelectAtLeastOne")) {
+				g.mode = utils::prompt_choice_mode::AT_LEAST_ONE;
+			} else {
+				g.mode = static_cast<utils::prompt_choice_mode>(0);
+			}
+			g.plugins.begin = ir_.plugins.size();
+			for (auto cur_node = group_node->children; cur_node; cur_node = cur_node->next) {
+				if(!is_elem(cur_node, "plugins"))
+					continue;
+				for (auto p_node = cur_node->children; p_node; p_node = p_node->next) {
+					if(!is_elem(p_node, "plugin"))
+						continue;
+					plugin(p_node);
+				}
+			}
+			g.plugins.end = ir_.plugins.size();
+			ir_.groups.emplace_back(g);
+		}
+
+		void step(xmlNode* step_node) {
+			const xc	x_name(xmlGetProp(step_node, (const xmlChar*)"name"));
+			ir_t::step	s;
+			s.name = (x_name) ? (const char*)x_name : "<no name>";
+			s.visible = ir_t::NONE;
+			// within an install step we may have
+			// the 'visible' node having dependency on flags
+			for(auto cur_node = step_node->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "visible") && (s.visible == ir_t::NONE)) {
+					s.visible = deps_node(cur_node);
+				}
+			}
+			// groups of nested plugins need to be
+			// contiguous, hence first compile them
+			// all and then add the step
+			s.groups.begin = ir_.groups.size();
+			for(auto ofg_node = step_node->children; ofg_node; ofg_node = ofg_node->next) {
+				if(!is_elem(ofg_node, "optionalFileGroups"))
+					continue;
+				for(auto group_node = ofg_node->children; group_node; group_node = group_node->next) {
+					if(!is_elem(group_node, "group"))
+						continue;
+					group(group_node);
+				}
+			}
+			s.groups.end = ir_.groups.size();
+			ir_.steps.emplace_back(s);
+		}
+
+		void pattern(xmlNode* ptn_node) {
+			xmlNode	*d = 0,
+				*files = 0;
+			for (auto cur_node = ptn_node->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "dependencies")) {
+					if(d)
+						throw std::runtime_error("Malformed 'conditionalFileInstalls', multiple 'dependencies' in same pattern");
+					d = cur_node;
+				} else if(is_elem(cur_node, "files")) {
+					if(files)
+						throw std::runtime_error("Malformed 'conditionalFileInstalls', multiple 'files' in same pattern");
+					files = cur_node;
+				}
+			}
+			// only when both set do something
+			if(!d || !files) {
+				LOG << "Pattern skipped due to missing 'dependencies' and/or 'files' sections";
+				return;
+			}
+			const uint32_t	c = deps_node(d);
+			ir_.patterns.push_back({c, ops(files->children)});
+		}
+public:
+		compiler(ir_t& ir) : ir_(ir) {
+		}
+
+		void run(xmlDocPtr doc) {
+			xmlNode	*n_moduleName = 0,
+				*n_installSteps = 0,
+				*n_requiredInstallFiles = 0,
+				*n_conditionalFileInstalls = 0;
+			auto root_element = xmlDocGetRootElement(doc);
+			for (auto cur_node = root_element->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "moduleName")) {
+					n_moduleName = cur_node;
+				} else if(is_elem(cur_node, "installSteps")) {
+					n_installSteps = cur_node;
+				} else if(is_elem(cur_node, "requiredInstallFiles")) {
+					n_requiredInstallFiles = cur_node;
+				} else if(is_elem(cur_node, "conditionalFileInstalls")) {
+					n_conditionalFileInstalls = cur_node;
+				}
+			}
+			LOG 	<< "Found 'moduleName' (" << (!!n_moduleName) << ") 'installSteps' (" << (!!n_installSteps)
+				<< ") 'requiredInstallFiles' (" << (!!n_requiredInstallFiles) << ") 'conditionalFileInstalls' ("
+				<< (!!n_conditionalFileInstalls) << ")";
+			if(!n_moduleName || !n_installSteps)
+				throw std::runtime_error("ModuleConfig is missing 'moduleName' and/or 'installSteps'");
+			ir_.module_name = utils::trim(xc(xmlNodeGetContent(n_moduleName)).c_str());
+			ir_.has_required = !!n_requiredInstallFiles;
+			ir_.required_ops = n_requiredInstallFiles ? ops(n_requiredInstallFiles->children) : ir_t::range{ 0, 0 };
+			for (auto cur_node = n_installSteps->children; cur_node; cur_node = cur_node->next) {
+				if(is_elem(cur_node, "installStep"))
+					step(cur_node);
+			}
+			if(n_conditionalFileInstalls) {
+				for (auto cur_node = n_conditionalFileInstalls->children; cur_node; cur_node = cur_node->next) {
+					if(!is_elem(cur_node, "patterns"))
+						continue;
+					for (auto ptn_node = cur_node->children; ptn_node; ptn_node = ptn_node->next) {
+						if(is_elem(ptn_node, "pattern"))
+							pattern(ptn_node);
+					}
+				}
+			}
+			LOG	<< "ModuleConfig compiled: " << ir_.steps.size() << " steps, " << ir_.groups.size() << " groups, "
+				<< ir_.plugins.size() << " plugins, " << ir_.ops.size() << " ops, " << ir_.flag_names.size() << " flags";
+		}
+	};
 }
 
+const uint32_t	modcfg::module_ir::NONE;
+
 void modcfg::parser::print_element_names(std::ostream& ostr, xmlNode * a_node, const int level) {
 	xmlNode *cur_node = NULL;
 	
@@ -41,145 +386,104 @@ void modcfg::parser::print_element_names(std::ostream& ostr, xmlNode * a_node, c
 	}
 }
 
-void modcfg::parser::init(void) {
-	auto root_element = xmlDocGetRootElement(doc_);
-	for (auto cur_node = root_element->children; cur_node; cur_node = cur_node->next) {
-		if (cur_node->type == XML_ELEMENT_NODE) {
-			if(std::string("moduleName") == (const char*)cur_node->name) {
-				n_moduleName_ = cur_node;
-			} else if(std::string("installSteps") == (const char*)cur_node->name) {
-				n_installSteps_ = cur_node;
-			} else if(std::string("requiredInstallFiles") == (const char*)cur_node->name) {
-				n_requiredInstallFiles_ = cur_node;
-			} else if(std::string("conditionalFileInstalls") == (const char*)cur_node->name) {
-				n_conditionalFileInstalls_ = cur_node;
-			}
-		}
-	}
-	LOG 	<< "Found 'moduleName' (" << (!!n_moduleName_) << ") 'installSteps' (" << (!!n_installSteps_)
-		<< ") 'requiredInstallFiles' (" << (!!n_requiredInstallFiles_) << ") 'conditionalFileInstalls' ("
-		<< (!!n_conditionalFileInstalls_) << ")";
-	if(!n_moduleName_ || !n_installSteps_)
-		throw std::runtime_error("ModuleConfig is missing 'moduleName' and/or 'installSteps'");
+void modcfg::parser::compile(void) {
+	compiler(ir_).run(doc_);
 }
 
 void modcfg::parser::display_name(std::ostream& ostr) {
-	ostr << utils::term::dim("Module: ") << utils::term::bold(xc(xmlNodeGetContent(n_moduleName_)).c_str()) << std::endl;
-}
-
-void modcfg::parser::copy_op_node(xmlNode* node, arc::file& a, const execute_info& ei) {
-	// now cycle through all requirements
-	for (auto cur_node = node; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("folder") == (const char*)cur_node->name) {
-			// get required attribs
-			const xc		x_src(xmlGetProp(cur_node, (const xmlChar*)"source")),
-						x_dst(xmlGetProp(cur_node, (const xmlChar*)"destination"));
-			if(!x_src)
-				throw std::runtime_error("Invalid ModuleConfig section, 'source' missing");
-			const std::string	src(utils::path2unix((const char*)x_src));
-			std::string		dst(utils::path2unix((x_dst) ? (const char*)x_dst : ""));
-			if(!dst.empty() && *dst.rbegin() != '/') {
-				dst += '/';
-			}
-			// now invoke the dir extraction/copy
-			const std::string	ovd = ei.override_dir.empty() ? "" : (ei.override_dir + (dst.empty() ? "" : dst));
-			a.extract_dir(src, ei.skyrim_data_dir + (dst.empty() ? "" : dst), ovd, ei.esp_files);
-		} else if(std::string("file") == (const char*)cur_node->name) {
-			const xc		x_src(xmlGetProp(cur_node, (const xmlChar*)"source")),
-						x_dst(xmlGetProp(cur_node, (const xmlChar*)"destination"));
-			if(!x_src)
-				throw std::runtime_error("Invalid ModuleConfig section, 'source' missing");
-			const std::string	src(utils::path2unix((const char*)x_src));
-			std::string		dst(utils::path2unix((x_dst) ? (const char*)x_dst : ""));
-			// in case dst is non empty is supposed to be a fully qualified
-			// file name, relative to 'Data' - skyrim_data_dir already
-			// conatains '/' at the end
-			std::string		tgt_filename = ei.skyrim_data_dir,
-						ovd_filename = ei.override_dir;
-			// if dst is non empty, we should simply append to tgt_filename
-			// otherwise we'll have to find the filename
-			// and concatenate
-			if(!dst.empty()) {
-				tgt_filename += dst;
-				if(!ovd_filename.empty()) ovd_filename += dst;
-			} else {
-				const auto	p_slash = src.find_last_of('/');
-				tgt_filename += src.substr((p_slash == std::string::npos) ? 0 : p_slash+1);
-				if(!ovd_filename.empty()) ovd_filename += src.substr((p_slash == std::string::npos) ? 0 : p_slash+1);
-			}
-			// now invoke the file extraction/copy
-			a.extract_file(src, tgt_filename, ovd_filename, ei.esp_files);
-		}
-	}
+	ostr << utils::term::dim("Module: ") << utils::term::bold(ir_.module_name) << std::endl;
 }
 
-bool modcfg::parser::required(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei) {
-	if(!n_requiredInstallFiles_)
+bool modcfg::parser::required(std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out) {
+	if(!ir_.has_required)
 		return true;
-	const auto res = utils::prompt_choice(ostr, istr, "Required files - Install?", "y,n");
+	answers::choice	res;
+	if(ei.replay) {
+		// by default install required files
+		if(!ei.ans->get(ir_.module_name, answers::file::REQ_STEP, answers::file::REQ_GROUP, res) || res.empty())
+			res.push_back("y");
+		ostr << "Required files - Install? " << utils::term::dim("(replay)") << " : " << res[0] << std::endl;
+	} else {
+		res = utils::prompt_choice(ostr, istr, "Required files - Install?", "y,n");
+		if(ei.ans)
+			ei.ans->set(ir_.module_name, answers::file::REQ_STEP, answers::file::REQ_GROUP, res);
+	}
 	if(!utils::is_yY(res[0]))
 		return false;
-	// now cycle through all copy requirements
-	copy_op_node(n_requiredInstallFiles_->children, a, ei);
+	for(uint32_t i = ir_.required_ops.begin; i < ir_.required_ops.end; ++i)
+		out.push_back(i);
 	return true;
 }
 
-std::vector<modcfg::parser::plugin_desc> modcfg::parser::get_plugin_options_display(xmlNode* plugins_node, std::ostream& ostr, std::string& csv_answers) {
-	std::stringstream	answ;
-	int			i = 0;
-	// scan through all plugins and prepare name/description
-	std::vector<plugin_desc>	pd;
-	for (auto cur_node = plugins_node->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("plugin") != (const char*)cur_node->name)
-			continue;
-		const xc		x_name(xmlGetProp(cur_node, (const xmlChar*)"name"));
-		if(!x_name)
-			throw std::runtime_error("Invalid plugin, 'name' attribute missing");
-		const std::string	name((const char*)x_name);
-		pd.emplace_back(plugin_desc{cur_node, name});
-		ostr << "\t\t" << i << '\t' << name << std::endl;
-		if(i > 0) answ << ',';
-		answ << i;
-		++i;
+modcfg::module_ir::plugin_type modcfg::parser::plugin_type(const module_ir::plugin& p) {
+	for(uint32_t i = p.type_patterns.begin; i < p.type_patterns.end; ++i) {
+		if(cond_check(ir_.type_patterns[i].cond))
+			return ir_.type_patterns[i].type;
 	}
-	csv_answers = answ.str();
-	return pd;
+	return p.def_type;
 }
 
-void modcfg::parser::plugin(xmlNode* plugin_node, arc::file& a, const execute_info& ei) {
-	for (auto cur_node = plugin_node->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		// if we're files section, do copy
-		if(std::string("files") == (const char*)cur_node->name) {
-			copy_op_node(cur_node->children, a, ei);
-		} else if (std::string("conditionFlags") == (const char*)cur_node->name) {
-			for (auto f_node = cur_node->children; f_node; f_node = f_node->next) {
-				if(f_node->type != XML_ELEMENT_NODE)
-					continue;
-				if(std::string("flag") != (const char*)f_node->name)
-					continue;
-				// we must have name... and possibly the value
-				const xc		x_name(xmlGetProp(f_node, (const xmlChar*)"name"));
-				if(!x_name)
-					throw std::runtime_error("Invalid plugin, flag 'name' attribute missing");
-				const std::string	name((const char*)x_name);
-				xc 			value(xmlNodeGetContent(f_node));
-				flags_[name] = std::string((const char*)value);
-			}
+std::vector<std::string> modcfg::parser::policy_choice(const module_ir::group& g, const utils::prompt_choice_mode pcm) {
+	// select all 'Required' and 'Recommended' plugins,
+	// then fix up the selection so that it satisfies
+	// the group constraints
+	std::vector<std::string>	req,
+					rec,
+					rv;
+	int				first_usable = -1;
+	for(uint32_t i = g.plugins.begin; i < g.plugins.end; ++i) {
+		const auto	type = plugin_type(ir_.plugins[i]);
+		const auto	idx = std::to_string(i - g.plugins.begin);
+		if(type == module_ir::T_REQUIRED) {
+			req.push_back(idx);
+		} else if(type == module_ir::T_RECOMMENDED) {
+			rec.push_back(idx);
 		}
+		if(type != module_ir::T_NOT_USABLE && first_usable < 0)
+			first_usable = i - g.plugins.begin;
+	}
+	rv = req;
+	rv.insert(rv.end(), rec.begin(), rec.end());
+	switch(pcm) {
+		case utils::prompt_choice_mode::ONE_ONLY:
+		case utils::prompt_choice_mode::AT_LEAST_ONE: {
+			if(rv.empty() && first_usable >= 0)
+				rv.push_back(std::to_string(first_usable));
+			if(pcm == utils::prompt_choice_mode::ONE_ONLY && rv.size() > 1)
+				rv.resize(1);
+		} break;
+		case utils::prompt_choice_mode::ONE_OR_NONE: {
+			if(rv.size() > 1)
+				rv.resize(1);
+		} break;
+		default:
+		break;
 	}
+	return rv;
+}
+
+void modcfg::parser::plugin(const module_ir::plugin& p, op_list& out) {
+	for(uint32_t i = p.ops.begin; i < p.ops.end; ++i)
+		out.push_back(i);
+	for(uint32_t i = p.flags.begin; i < p.flags.end; ++i)
+		flags_[ir_.flag_sets[i].flag] = ir_.flag_sets[i].value;
 }
 
-void modcfg::parser::group_SelectX(xmlNode* plugins_node, std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei, const utils::prompt_choice_mode pcm) {
-	std::string	answ;
-	auto		pd = get_plugin_options_display(plugins_node, ostr, answ);
+void modcfg::parser::group(const module_ir::group& g, const module_ir::step& s, std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out) {
+	ostr << "\t" << utils::term::green(g.name) << std::endl;
+	// unknown group type
+	if(!g.mode)
+		return;
+	// display name of plugins
+	std::stringstream	answ;
+	for(uint32_t i = g.plugins.begin; i < g.plugins.end; ++i) {
+		const uint32_t	idx = i - g.plugins.begin;
+		ostr << "\t\t" << idx << '\t' << ir_.plugins[i].name << std::endl;
+		if(idx > 0) answ << ',';
+		answ << idx;
+	}
 	const char	*desc = "none";
-	switch(pcm) {
+	switch(g.mode) {
 		case utils::prompt_choice_mode::ONE_ONLY:
 		desc = "\tSelect one";
 		break;
@@ -193,119 +497,117 @@ void modcfg::parser::group_SelectX(xmlNode* plugins_node, std::ostream& ostr, st
 		desc = "\tSelect one or more";
 		break;
 	}
-	const auto	rv = prompt_choice(ostr, istr, desc, answ, pcm);
+	std::vector<std::string>	rv;
+	if(ei.replay) {
+		// answers are stored by plugin name, map
+		// those back to the indices
+		answers::choice	c;
+		bool		valid = ei.ans->get(ir_.module_name, s.name, g.name, c);
+		for(const auto& n : c) {
+			uint32_t	idx = g.plugins.begin;
+			while(idx < g.plugins.end && ir_.plugins[idx].name != n)
+				++idx;
+			if(idx == g.plugins.end) {
+				ostr << utils::term::yellow(std::string("Warning: answer '") + n + "' not found in group '" + g.name + "', using policy") << std::endl;
+				valid = false;
+				break;
+			}
+			if(plugin_type(ir_.plugins[idx]) == module_ir::T_NOT_USABLE) {
+				ostr << utils::term::yellow(std::string("Warning: answer '") + n + "' is not usable in group '" + g.name + "', using policy") << std::endl;
+				valid = false;
+				break;
+			}
+			rv.push_back(std::to_string(idx - g.plugins.begin));
+		}
+		// the module may have changed since the answers
+		// got recorded, they still have to fit the group
+		if(valid) {
+			bool	fit = true;
+			switch(g.mode) {
+				case utils::prompt_choice_mode::ONE_ONLY:
+				fit = (rv.size() == 1);
+				break;
+				case utils::prompt_choice_mode::ONE_OR_NONE:
+				fit = (rv.size() <= 1);
+				break;
+				case utils::prompt_choice_mode::AT_LEAST_ONE:
+				fit = !rv.empty();
+				break;
+				default:
+				break;
+			}
+			if(!fit) {
+				ostr << utils::term::yellow(std::string("Warning: answers don't satisfy the constraints of group '") + g.name + "', using policy") << std::endl;
+				valid = false;
+			}
+		}
+		const char	*src = "(replay)";
+		if(!valid) {
+			rv = policy_choice(g, g.mode);
+			src = "(policy)";
+		}
+		ostr << desc << ' ' << utils::term::dim(src) << " : ";
+		for(size_t i = 0; i < rv.size(); ++i)
+			ostr << ((i == 0) ? "" : ",") << rv[i];
+		ostr << std::endl;
+	} else {
+		rv = utils::prompt_choice(ostr, istr, desc, answ.str(), g.mode);
+	}
+	answers::choice	rec;
+	const int	n_plugins = g.plugins.end - g.plugins.begin;
 	for(const auto& i : rv) {
 		const int	idx = std::atoi(i.c_str());
 		if(idx < 0)
 			continue;
 		// this should never happen
-		if(idx >= (int)pd.size())
-			continue;
-		plugin(pd[idx].node, a, ei);
-	}
-}
-
-void modcfg::parser::group(xmlNode* group_node, std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei) {
-	const xc		x_name(xmlGetProp(group_node, (const xmlChar*)"name")),
-				x_type(xmlGetProp(group_node, (const xmlChar*)"type"));
-	if(!x_type)
-		throw std::runtime_error("Invalid group, 'type' attribute missing");
-	const std::string	name((x_name) ? (const char*)x_name : "<no name>"),
-				type((const char*)x_type);
-	ostr << "\t" << utils::term::green(name) << std::endl;
-	for (auto cur_node = group_node->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
+		if(idx >= n_plugins)
 			continue;
-		if(std::string("plugins") != (const char*)cur_node->name)
-			continue;
-		if(type == "SelectExactlyOne") {
-			group_SelectX(cur_node, ostr, istr, a, ei, utils::prompt_choice_mode::ONE_ONLY);
-		} else if(type == "SelectAtMostOne") {
-			group_SelectX(cur_node, ostr, istr, a, ei, utils::prompt_choice_mode::ONE_OR_NONE);
-		} else if(type == "SelectAny") {
-			group_SelectX(cur_node, ostr, istr, a, ei, utils::prompt_choice_mode::ANY);
-		} else if(type == "SelectAtLeastOne") {
-			group_SelectX(cur_node, ostr, istr, a, ei, utils::prompt_choice_mode::AT_LEAST_ONE);
-		}
+		const auto&	p = ir_.plugins[g.plugins.begin + idx];
+		plugin(p, out);
+		rec.push_back(p.name);
 	}
+	if(ei.ans && !ei.replay)
+		ei.ans->set(ir_.module_name, s.name, g.name, rec);
 }
 
-bool modcfg::parser::flag_dep_check(xmlNode* cur_node, const dep_check_mode dcm, std::ostream* ostr) {
-	for(auto fd_node = cur_node; fd_node; fd_node = fd_node->next) {
-		if(fd_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("flagDependency") != (const char*)fd_node->name)
-			continue;
-		const xc	x_flag(xmlGetProp(fd_node, (const xmlChar*)"flag")),
-				x_value(xmlGetProp(fd_node, (const xmlChar*)"value"));
-		if(!x_flag)
-			throw std::runtime_error("Malformed 'flagDependency' section - 'flag' missing");
-		const auto	it = flags_.find(x_flag.c_str());
-		// apply logic depending on the mode
-		// short circuit in AND and OR mode
-		switch(dcm) {
-			case dep_check_mode::OR: {
-				if(flags_.end() != it) {
-					if(!x_value) {
-						if(ostr) *ostr << x_flag.c_str() << " ";
-						return true;
-					}
-					else if (it->second == x_value.c_str()) {
-						if(ostr) *ostr << x_flag.c_str() << "{" << x_value.c_str() << "} ";
-						return true;
-					}
-				}
-			} break;
-			default:
-			case dep_check_mode::AND: {
-				if(flags_.end() == it)
+bool modcfg::parser::cond_check(const uint32_t c) {
+	const auto&	cd = ir_.conds[c];
+	switch(cd.type) {
+		case module_ir::C_FLAG: {
+			const uint32_t	v = flags_[cd.id];
+			return (v != module_ir::NONE) && ((cd.value == module_ir::NONE) || (v == cd.value));
+		} break;
+		case module_ir::C_FILE: {
+			const auto&	f = ir_.file_deps[cd.id];
+			const auto	st = didx_ ? didx_->state(f) : dataidx::index::file_state::MISSING;
+			LOG << "fileDependency '" << f << "' state " << st << " (expected " << cd.value << ")";
+			return st == static_cast<dataidx::index::file_state>(cd.value);
+		} break;
+		case module_ir::C_TRUE: {
+			return true;
+		} break;
+		case module_ir::C_OR: {
+			// short circuit, an empty 'Or' is false
+			for(uint32_t i = cd.children.begin; i < cd.children.end; ++i)
+				if(cond_check(ir_.cond_children[i]))
+					return true;
+			return false;
+		} break;
+		default:
+		case module_ir::C_AND: {
+			for(uint32_t i = cd.children.begin; i < cd.children.end; ++i)
+				if(!cond_check(ir_.cond_children[i]))
 					return false;
-				if(x_value && (it->second != x_value.c_str()))
-					return false;
-				if(ostr) {
-					*ostr << x_flag.c_str();
-					if(x_value) *ostr << "{" << x_value.c_str() << "}";
-					*ostr << " ";
-				}
-			} break;
-		}
+			return true;
+		} break;
 	}
-	// given we're short circuiting if we reach
-	// this point and are in OR mode, then means
-	// no condition was satisfied - hence false
-	// if instead we're in AND mode, it means all
-	// was satisfied, hence return true
-	return (dcm == dep_check_mode::OR) ? false : true;
 }
 
-void modcfg::parser::steps(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei) {
-	// reset flags at this stage
-	flags_.clear();
+void modcfg::parser::steps(std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out) {
 	int  i = 0;
-	for (auto cur_node = n_installSteps_->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("installStep") != (const char*)cur_node->name)
-			continue;
-
-		// within an install step we may have
-		// the 'visible' node having dependency on flags
-		bool	skip = false;
-		for(auto vis_node = cur_node->children; vis_node; vis_node = vis_node->next) {
-			if(vis_node->type != XML_ELEMENT_NODE)
-				continue;
-			if(std::string("visible") != (const char*)vis_node->name)
-				continue;
-			// within visible, search for all 'flagDependency'
-			if(!flag_dep_check(vis_node->children)) {
-				skip = true;
-				break;
-			}
-		}
-		const xc		x_name(xmlGetProp(cur_node, (const xmlChar*)"name"));
-		const std::string	name((x_name) ? (const char*)x_name : "<no name>");
-		if(skip) {
-			LOG << "Step '" << name << "' skipped due to missing dependency";
+	for(const auto& s : ir_.steps) {
+		if(s.visible != module_ir::NONE && !cond_check(s.visible)) {
+			LOG << "Step '" << s.name << "' skipped due to missing dependency";
 			continue;
 		}
 
@@ -313,86 +615,30 @@ void modcfg::parser::steps(std::ostream& ostr, std::istream& istr, arc::file& a,
 		//
 		std::stringstream	step_title;
 		step_title << "Install step " << i << ": ";
-		ostr << utils::term::dim(step_title.str()) << utils::term::blue(name) << std::endl;
-		// get 'optionalFileGroups' tokens...
-		for(auto ofg_node = cur_node->children; ofg_node; ofg_node = ofg_node->next) {
-			if(ofg_node->type != XML_ELEMENT_NODE)
-				continue;
-			if(std::string("optionalFileGroups") != (const char*)ofg_node->name)
-				continue;
-			// get 'group'
-			for(auto group_node = ofg_node->children; group_node; group_node = group_node->next) {
-				if(group_node->type != XML_ELEMENT_NODE)
-					continue;
-				if(std::string("group") != (const char*)group_node->name)
-					continue;
-				group(group_node, ostr, istr, a, ei);
-			}
-		}
-	}
-}
-
-void modcfg::parser::pattern(xmlNode* pattern, arc::file& a, const execute_info& ei) {
-	xmlNode	*deps = 0,
-		*files = 0;
-	for (auto cur_node = pattern->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("dependencies") == (const char*)cur_node->name) {
-			if(deps)
-				throw std::runtime_error("Malformed 'conditionalFileInstalls', multiple 'dependencies' in same pattern");
-			deps = cur_node;
-		} else if(std::string("files") == (const char*)cur_node->name) {
-			if(files)
-				throw std::runtime_error("Malformed 'conditionalFileInstalls', multiple 'files' in same pattern");
-			files = cur_node;
-		}
-	}
-	// only when both set do something
-	if(deps && files) {
-		// default enforce all 'flagDependency' to be checked
-		// only use 'Or' if set as such
-		dep_check_mode	dcm = dep_check_mode::AND;
-		const xc	op_mode(xmlGetProp(deps, (const xmlChar*)"operator"));
-		if(op_mode) {
-			if(std::string("Or") == op_mode.c_str())
-				dcm = dep_check_mode::OR;
-		}
-		std::ostringstream	ostr;
-		if(!flag_dep_check(deps->children, dcm, &ostr)) {
-			LOG << "Pattern skipped due dependecies not satisfied; so far: " << ostr.str();
-			return;
-		}
-		LOG << "Pattern being executed due to dependecies satisfied: " << ostr.str();
-		copy_op_node(files->children, a, ei);
-	} else {
-		LOG << "Pattern skipped due to missing 'dependencies' and/or 'files' sections";
+		ostr << utils::term::dim(step_title.str()) << utils::term::blue(s.name) << std::endl;
+		for(uint32_t g = s.groups.begin; g < s.groups.end; ++g)
+			group(ir_.groups[g], s, ostr, istr, ei, out);
 	}
 }
 
-void modcfg::parser::cond(arc::file& a, const execute_info& ei) {
-	if(!n_conditionalFileInstalls_)
-		return;
-	for (auto cur_node = n_conditionalFileInstalls_->children; cur_node; cur_node = cur_node->next) {
-		if(cur_node->type != XML_ELEMENT_NODE)
-			continue;
-		if(std::string("patterns") != (const char*)cur_node->name)
+void modcfg::parser::cond(op_list& out) {
+	for(size_t i = 0; i < ir_.patterns.size(); ++i) {
+		const auto&	p = ir_.patterns[i];
+		if(!cond_check(p.cond)) {
+			LOG << "Pattern " << i << " skipped due dependecies not satisfied";
 			continue;
-		// single pattern
-		for (auto ptn_node = cur_node->children; ptn_node; ptn_node = ptn_node->next) {
-			if(ptn_node->type != XML_ELEMENT_NODE)
-				continue;
-			if(std::string("pattern") != (const char*)ptn_node->name)
-				continue;
-			pattern(ptn_node, a, ei);
 		}
+		LOG << "Pattern " << i << " being executed due to dependecies satisfied";
+		for(uint32_t o = p.ops.begin; o < p.ops.end; ++o)
+			out.push_back(o);
 	}
 }
 
-modcfg::parser::parser(const std::string& s) : s_(s), doc_(0), n_moduleName_(0), n_installSteps_(0), n_requiredInstallFiles_(0), n_conditionalFileInstalls_(0) {
+modcfg::parser::parser(const std::string& s) : s_(s), doc_(0), didx_(0) {
 	doc_ = xmlReadMemory(s_.c_str(), s_.length(), "noname.xml", NULL, 0);
 	if(!doc_)
 		throw std::runtime_error("Can't parse XML of ModuleConfig");
+	compile();
 }
 
 void modcfg::parser::print_tree(std::ostream& ostr) {
@@ -400,13 +646,42 @@ void modcfg::parser::print_tree(std::ostream& ostr) {
 	print_element_names(ostr, root_element);
 }
 
-void modcfg::parser::execute(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei) {
-	init();
+const modcfg::module_ir& modcfg::parser::ir(void) const {
+	return ir_;
+}
+
+modcfg::parser::op_list modcfg::parser::resolve(std::ostream& ostr, std::istream& istr, const execute_info& ei) {
+	// reset flags at this stage
+	flags_.assign(ir_.flag_names.size(), module_ir::NONE);
+	didx_ = ei.didx;
+	op_list	out;
 	display_name(ostr);
-	if(!required(ostr, istr, a, ei))
+	if(!required(ostr, istr, ei, out))
 		throw std::runtime_error("Required files present but skipped - aborting install");
-	steps(ostr, istr, a, ei);
-	cond(a, ei);
+	steps(ostr, istr, ei, out);
+	cond(out);
+	return out;
+}
+
+void modcfg::parser::apply(const op_list& ops, arc::file& a, const execute_info& ei) {
+	// resolve all the ops first, so that each
+	// target is written exactly once
+	std::vector<arc::copy_op>	c_ops;
+	for(const auto& i : ops)
+		c_ops.push_back(ir_.ops[i]);
+	auto	p = a.plan_ops(c_ops);
+	// reuse the casing of what's already in Data, so
+	// that i.e. 'Textures' and 'textures' won't both
+	// get created
+	if(ei.didx) {
+		for(auto& i : p)
+			i.target = ei.didx->cased(i.target);
+	}
+	a.extract_plan(p, ei.skyrim_data_dir, ei.override_dir, ei.esp_files);
+}
+
+void modcfg::parser::execute(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei) {
+	apply(resolve(ostr, istr, ei), a, ei);
 }
 
 modcfg::parser::~parser() {
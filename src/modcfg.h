@@ -15,62 +15,163 @@
     along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
  * */
 
+
 #ifndef _MODCFG_H_
 #define _MODCFG_H_
 
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
-#include <unordered_map>
 #include "arc.h"
 #include "utils.h"
+#include "answers.h"
+#include "dataidx.h"
 
 namespace modcfg {
+	// compiled ModuleConfig: all the entities are stored
+	// in flat arrays referencing each other by index,
+	// flag names and values are interned to integer ids
+	// and all paths are already normalized
+	struct module_ir {
+		static const uint32_t	NONE = 0xFFFFFFFF;
+
+		enum plugin_type {
+			T_OPTIONAL = 0,
+			T_REQUIRED,
+			T_RECOMMENDED,
+			T_NOT_USABLE,
+			T_COULD_BE_USABLE
+		};
+
+		enum cond_type {
+			C_FLAG = 0,
+			C_FILE,
+			C_TRUE,
+			C_AND,
+			C_OR
+		};
+
+		struct range {
+			uint32_t	begin,
+					end;
+		};
+
+		typedef arc::copy_op	op;
+
+		struct flag_set {
+			uint32_t	flag,
+					value;
+		};
+
+		// node of a dependencies tree; for C_FLAG 'id'
+		// is the flag and a 'value' of NONE means any
+		// value, for C_FILE 'id' is the index in
+		// file_deps and 'value' the dataidx::file_state
+		struct cond {
+			cond_type	type;
+			uint32_t	id,
+					value;
+			range		children;
+		};
+
+		struct type_pattern {
+			uint32_t	cond;
+			plugin_type	type;
+		};
+
+		struct plugin {
+			std::string	name;
+			range		ops,
+					flags,
+					type_patterns;
+			plugin_type	def_type;
+		};
+
+		// a group with 'mode' set to 0 has an unknown
+		// type and gets skipped
+		struct group {
+			std::string			name;
+			utils::prompt_choice_mode	mode;
+			range				plugins;
+		};
+
+		struct step {
+			std::string	name;
+			uint32_t	visible;
+			range		groups;
+		};
+
+		struct pattern {
+			uint32_t	cond;
+			range		ops;
+		};
+
+		std::string			module_name;
+		bool				has_required;
+		range				required_ops;
+		std::vector<step>		steps;
+		std::vector<group>		groups;
+		std::vector<plugin>		plugins;
+		std::vector<op>			ops;
+		std::vector<flag_set>		flag_sets;
+		std::vector<cond>		conds;
+		std::vector<uint32_t>		cond_children;
+		std::vector<type_pattern>	type_patterns;
+		std::vector<pattern>		patterns;
+		std::vector<std::string>	flag_names,
+						flag_values,
+						file_deps;
+	};
+
 	class parser {
 public:
 		struct execute_info {
 			std::string	skyrim_data_dir,
 					override_dir;
 			arc::file_names	*esp_files;
+			// when set, answers are recorded into it or,
+			// if replay is set, read from it without
+			// prompting at all
+			answers::file	*ans;
+			bool		replay;
+			// used to evaluate 'fileDependency', if not
+			// set all files are considered missing
+			dataidx::index	*didx;
 		};
+
+		// list of indices of module_ir::ops to be
+		// executed, in order
+		typedef std::vector<uint32_t>	op_list;
 private:
 		const std::string	s_;
 		xmlDocPtr		doc_;
-		xmlNode			*n_moduleName_,
-					*n_installSteps_,
-					*n_requiredInstallFiles_,
-					*n_conditionalFileInstalls_;
-
-		std::unordered_map<std::string, std::string>	flags_;
+		module_ir		ir_;
+		// current value id of each flag
+		std::vector<uint32_t>	flags_;
+		dataidx::index		*didx_;
 
 		void print_element_names(std::ostream& ostr, xmlNode * a_node, const int level = 0);
-		void init(void);
+		void compile(void);
 		void display_name(std::ostream& ostr);
-		void copy_op_node(xmlNode* node, arc::file& a, const execute_info& ei);
-		bool required(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei);
-
-		struct plugin_desc {
-			xmlNode*	node;
-			std::string	name;
-		};
-
-		std::vector<plugin_desc> get_plugin_options_display(xmlNode* plugins_node, std::ostream& ostr, std::string& csv_answers);
-		void plugin(xmlNode* plugin_node, arc::file& a, const execute_info& ei);
-		void group_SelectX(xmlNode* plugins_node, std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei, const utils::prompt_choice_mode pcm);
-		void group(xmlNode* group_node, std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei);
-
-		enum dep_check_mode {
-			AND = 1,
-			OR
-		};
-
-		bool flag_dep_check(xmlNode* cur_node, const dep_check_mode dcm = dep_check_mode::AND, std::ostream* ostr = 0);
-		void steps(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei);
-		void pattern(xmlNode* pattern, arc::file& a, const execute_info& ei);
-		void cond(arc::file& a, const execute_info& ei);
+		bool required(std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out);
+		module_ir::plugin_type plugin_type(const module_ir::plugin& p);
+		std::vector<std::string> policy_choice(const module_ir::group& g, const utils::prompt_choice_mode pcm);
+		void plugin(const module_ir::plugin& p, op_list& out);
+		void group(const module_ir::group& g, const module_ir::step& s, std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out);
+		bool cond_check(const uint32_t c);
+		void steps(std::ostream& ostr, std::istream& istr, const execute_info& ei, op_list& out);
+		void cond(op_list& out);
 public:
 		parser(const std::string& s);
 		void print_tree(std::ostream& ostr);
+		const module_ir& ir(void) const;
+		// evaluates the ModuleConfig (prompting or using
+		// the answers as per ei) and returns the copy ops
+		// to be executed, without touching any archive
+		op_list resolve(std::ostream& ostr, std::istream& istr, const execute_info& ei);
+		void apply(const op_list& ops, arc::file& a, const execute_info& ei);
 		void execute(std::ostream& ostr, std::istream& istr, arc::file& a, const execute_info& ei);
 		~parser();
 	};
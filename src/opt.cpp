@@ -27,11 +27,30 @@ bool		opt::use_term_style = true,
 		opt::xml_debug = false,
 		opt::override_list = false,
 		opt::override_list_replace = false,
+		opt::override_list_bsa_replace = false,
 		opt::override_list_verify = false,
-		opt::override_list_remove = false;
+		opt::override_list_verify_fast = false,
+		opt::override_list_remove = false,
+		opt::override_redeploy = false,
+		opt::override_move_after = false,
+		opt::override_pack_bsa = false,
+		opt::override_dedup_store = false,
+		opt::server_daemon = false,
+		opt::server_remote = false,
+		opt::profile_list = false,
+		opt::sort_plugins = false;
 std::string	opt::skyrim_se_data,
 		opt::skyrim_se_plugins,
-		opt::override_data;
+		opt::override_data,
+		opt::fuse_mount,
+		opt::override_move,
+		opt::override_move_tgt,
+		opt::answers_record,
+		opt::answers_replay,
+		opt::override_deploy_mode,
+		opt::server_socket,
+		opt::profile_set,
+		opt::profile_use;
 
 namespace {
 	// settings/options management
@@ -39,7 +58,8 @@ namespace {
 		std::cerr <<	"Usage: " << prog << " [options] <mod1.7z> <mod2.rar> <mod3...>\nExecutes skyrim-pm " << version << "\n"
 			  <<	"\nBasic options (files will be overwritten in Data directory)\n\n"
 			  <<	"-s,--sse-data d   Use specified Skyrim SE Data directory (d). If not set, skyrim-pm\n"
-			  <<    "                  will try to invoke 'locate' to find it and use the first entry\n"
+			  <<    "                  will look for it in the Steam libraries (libraryfolders.vdf) and\n"
+			  <<    "                  cache the result in ~/.config/skyrim-pm/paths.conf\n"
 			  <<	"-x,--data-ext     Try to extract the archive no matter what even when ModuleConfig.xml\n"
 			  <<	"                  can't be found. In this case all files which match a given criteria\n"
 			  <<	"                  will be extracted and saved under the specified Data directory\n"
@@ -50,6 +70,15 @@ namespace {
 			  <<	"                  <Local Settings/Application Data/Skyrim Special Edition/Plugins.txt>\n"
 			  <<	"--auto-plugins    Automatically find 'Plugins.txt' file and if found behaves as if option\n"
 			  <<	"                  -p (or --plugins) got set to same file name (default disabled)\n"
+			  <<	"--sort-plugins    Sorts the load order in 'Plugins.txt' (requires -p or --auto-plugins)\n"
+			  <<	"                  once the mods have been installed: masters go first and each plugin\n"
+			  <<	"                  is loaded after its own masters (read from the plugin headers under\n"
+			  <<	"                  Data), otherwise the existing order is kept; can run without any mod\n"
+			  <<	"--answers-record f Records all the ModuleConfig answers (keyed by module, step and group\n"
+			  <<	"                  names) into file (f), merging with its existing content\n"
+			  <<	"--answers-replay f Installs without any prompt, using the answers from file (f); groups\n"
+			  <<	"                  without a (valid) answer select their 'Required' and 'Recommended'\n"
+			  <<	"                  plugins, or the first usable one when a selection is mandatory\n"
 			  <<	"\nOverride options (files will be saved in override directory and only symlinks will be\n"
 			  <<	"written in Data directory - furthermore the file Data/skyrim-pm-fso.xml will be used\n"
 			  <<	"to control such overrides over time)\n\n"
@@ -58,15 +87,76 @@ namespace {
 			  <<	"                  write a new 'xml' file under 'Data' directory to manage such symlinks.\n"
 			  <<	"                  If an existing file is present under 'Data' it will be overwritten by\n"
 			  <<	"                  the symlinks and won't be recoverable\n"
+			  <<	"--pack-bsa        After installing each mod, packs its loose files under 'meshes',\n"
+			  <<	"                  'textures', 'sound' and 'interface' (but the ones replacing files of\n"
+			  <<	"                  other mods) into a BSA named as the mod plugin, creating a dummy ESL\n"
+			  <<	"                  flagged plugin when the mod has none; only the BSA gets linked in Data\n"
+			  <<	"--deploy-mode m   How the override files are deployed under Data: 'symlink' (default),\n"
+			  <<	"                  'hardlink', 'reflink' or 'fuse' (hardlinks and reflinks need the override\n"
+			  <<	"                  directory on the same filesystem as Data, reflinks a filesystem\n"
+			  <<	"                  supporting them, i.e. btrfs or xfs); with 'fuse' nothing is written\n"
+			  <<	"                  under Data: installs, --list-remove, --move and --redeploy only edit\n"
+			  <<	"                  the override config, served by the --fuse-mount view. Stored in the\n"
+			  <<	"                  override config, switching it for already installed plugins requires\n"
+			  <<	"                  --redeploy\n"
+			  <<	"--dedup-store     Saves each extracted file content only once in the store of the\n"
+			  <<	"                  override directory ('.store', blobs named by SHA-256), the files of\n"
+			  <<	"                  the mods being hard links to it; blobs get deleted when the last mod\n"
+			  <<	"                  using them is removed. Identical files are shared, hence the blobs are\n"
+			  <<	"                  read-only: never edit deployed files in place, reinstall the mod\n"
 			  <<	"-l,--list-ovd     Lists all overrides/installed plugins\n"
 			  <<	"--list-replace    Lists all the overridden files which have been replaced by successive\n"
 			  <<	"                  plugins (i.e. when plugins/mods potentially have conflicted during setup\n"
 			  <<	"                  process)\n"
-			  <<	"--list-verify     Checks all the symlinks in the override config file are still present\n"
+			  <<	"--list-bsa-replace Lists all the assets provided by more than one plugin where at least\n"
+			  <<	"                  one copy comes from a BSA (including the BSAs of the base game in\n"
+			  <<	"                  Data), first the winning one: loose files win over BSAs, then BSAs\n"
+			  <<	"                  follow the load order of their plugins in Plugins.txt (install\n"
+			  <<	"                  order when Plugins.txt isn't known)\n"
+			  <<	"--list-verify     Checks all the links in the override config file are still present\n"
 			  <<	"                  under Data and also that all the files in such config are still available\n"
 			  <<	"                  on the filesystem\n"
+			  <<	"--list-verify-fast Same as --list-verify, but the files whose fingerprint (device, inode,\n"
+			  <<	"                  size and modification time) is the one recorded at install or at the\n"
+			  <<	"                  last check are not opened nor read; fingerprints of the files found\n"
+			  <<	"                  correct get saved in the override config\n"
 			  <<	"-r,--list-remove  Try to remove the listed plugins, restoring the previous overridden symlinks\n"
 			  <<	"                  when applicable\n"
+			  <<	"--move m          Changes the priority of installed plugin (m), to be used with either\n"
+			  <<	"                  --before or --after; only the symlinks of conflicting files whose\n"
+			  <<	"                  winner changes are updated (no archive is read)\n"
+			  <<	"--before t        Moves plugin set with --move right before plugin (t)\n"
+			  <<	"--after t         Moves plugin set with --move right after plugin (t)\n"
+			  <<	"--redeploy        Rebuilds the links under Data from the override config file, fixing\n"
+			  <<	"                  only the ones which are missing or point to the wrong file and removing\n"
+			  <<	"                  stale ones pointing into the override directory (no archive is read)\n"
+			  <<	"--fuse-mount m    Mounts on directory (m) a read-only union view of Data and the override\n"
+			  <<	"                  config. Changes to the override config (plugins added, removed or moved)\n"
+			  <<	"                  are picked up while mounted; only with '--deploy-mode fuse' they don't\n"
+			  <<	"                  also create/remove links under Data, in which case mount the view where\n"
+			  <<	"                  the game expects Data and keep running skyrim-pm on the real one, as the\n"
+			  <<	"                  config can't be edited through the view. Requires build with 'make FUSE=1'\n"
+			  <<	"--profile-set p   Saves profile (p) as the installed plugins listed (as with -r), replacing it\n"
+			  <<	"                  if existing, and builds its directory <Data>.profiles/(p): a symlink farm\n"
+			  <<	"                  with the files of Data and the ones of such plugins; the first time Data\n"
+			  <<	"                  gets moved to <Data>.profiles/default and replaced by a symlink to it\n"
+			  <<	"--profile-use p   Updates (only the links which differ) the directory of profile (p) and\n"
+			  <<	"                  switches Data to it with a single symlink rename; 'default' is Data as\n"
+			  <<	"                  installed, with all the plugins. Installs, removes and any other change\n"
+			  <<	"                  need the default profile active\n"
+			  <<	"--profile-list    Lists the profiles and their plugins\n"
+			  <<	"\nServer options\n\n"
+			  <<	"--daemon          Keeps the override config and the index of Data loaded and serves the\n"
+			  <<	"                  requests sent with --remote, one at a time, until interrupted; the\n"
+			  <<	"                  directories and files given here are the defaults of each request, the\n"
+			  <<	"                  other options (i.e. --sort-plugins) are not applied to them. With an\n"
+			  <<	"                  override directory, changes under Data and it get tracked (inotify) so\n"
+			  <<	"                  that --list-verify and --redeploy sent with --remote only check the\n"
+			  <<	"                  changed entries; run without --remote they always check everything\n"
+			  <<	"--remote          Runs the command (all the other options and mods) on the server, with\n"
+			  <<	"                  the current terminal and directory, exiting with its exit code\n"
+			  <<	"--socket f        Use unix socket (f) for --daemon/--remote, by default\n"
+			  <<	"                  $XDG_RUNTIME_DIR/skyrim-pm.sock\n"
 			  <<	"\nMisc/Debug options\n\n"
 			  <<	"-h,--help         Print this text and exits\n"
 			  <<	"--log             Print log on std::cerr (default not set)\n"
@@ -84,17 +174,39 @@ int opt::parse_args(int argc, char *argv[], const char *prog, const char *versio
 		{"data-ext",		no_argument,	   0,	'x'},
 		{"plugins",		required_argument, 0,	'p'},
 		{"auto-plugins",	no_argument,	   0,	0},
+		{"sort-plugins",	no_argument,	   0,	0},
+		{"answers-record",	required_argument, 0,	0},
+		{"answers-replay",	required_argument, 0,	0},
 		{"override",		required_argument, 0,	'o'},
+		{"pack-bsa",		no_argument,	   0,	0},
+		{"deploy-mode",		required_argument, 0,	0},
+		{"dedup-store",		no_argument,	   0,	0},
 		{"list-ovd",		no_argument,	   0,	'l'},
 		{"list-replace",	no_argument,	   0,	0},
+		{"list-bsa-replace",	no_argument,	   0,	0},
 		{"list-verify",		no_argument,	   0,	0},
+		{"list-verify-fast",	no_argument,	   0,	0},
 		{"list-remove",		no_argument,	   0,	'r'},
+		{"redeploy",		no_argument,	   0,	0},
+		{"fuse-mount",		required_argument, 0,	0},
+		{"daemon",		no_argument,	   0,	0},
+		{"remote",		no_argument,	   0,	0},
+		{"socket",		required_argument, 0,	0},
+		{"profile-set",		required_argument, 0,	0},
+		{"profile-use",		required_argument, 0,	0},
+		{"profile-list",	no_argument,	   0,	0},
+		{"move",		required_argument, 0,	0},
+		{"before",		required_argument, 0,	0},
+		{"after",		required_argument, 0,	0},
 		{"log",			no_argument,	   0,	0},
 		{"no-colors",		no_argument,	   0,	0},
 		{"xml-debug",		no_argument,	   0,	0},
 		{0, 0, 0, 0}
 	};
 
+	// a full rescan, the server parses
+	// the arguments of each request
+	optind = 0;
 	while (1) {
 		// getopt_long stores the option index here
 		int		option_index = 0;
@@ -115,10 +227,50 @@ int opt::parse_args(int argc, char *argv[], const char *prog, const char *versio
 				opt::xml_debug = true;
 			} else if(!std::strcmp("auto-plugins", long_options[option_index].name)) {
 				opt::auto_plugins = true;
+			} else if(!std::strcmp("sort-plugins", long_options[option_index].name)) {
+				opt::sort_plugins = true;
+			} else if(!std::strcmp("answers-record", long_options[option_index].name)) {
+				opt::answers_record = optarg;
+			} else if(!std::strcmp("answers-replay", long_options[option_index].name)) {
+				opt::answers_replay = optarg;
+			} else if(!std::strcmp("pack-bsa", long_options[option_index].name)) {
+				opt::override_pack_bsa = true;
+			} else if(!std::strcmp("dedup-store", long_options[option_index].name)) {
+				opt::override_dedup_store = true;
+			} else if(!std::strcmp("deploy-mode", long_options[option_index].name)) {
+				opt::override_deploy_mode = optarg;
 			} else if(!std::strcmp("list-replace", long_options[option_index].name)) {
 				opt::override_list_replace = true;
+			} else if(!std::strcmp("list-bsa-replace", long_options[option_index].name)) {
+				opt::override_list_bsa_replace = true;
 			} else if(!std::strcmp("list-verify", long_options[option_index].name)) {
 				opt::override_list_verify = true;
+			} else if(!std::strcmp("list-verify-fast", long_options[option_index].name)) {
+				opt::override_list_verify_fast = true;
+			} else if(!std::strcmp("redeploy", long_options[option_index].name)) {
+				opt::override_redeploy = true;
+			} else if(!std::strcmp("fuse-mount", long_options[option_index].name)) {
+				opt::fuse_mount = optarg;
+			} else if(!std::strcmp("daemon", long_options[option_index].name)) {
+				opt::server_daemon = true;
+			} else if(!std::strcmp("remote", long_options[option_index].name)) {
+				opt::server_remote = true;
+			} else if(!std::strcmp("socket", long_options[option_index].name)) {
+				opt::server_socket = optarg;
+			} else if(!std::strcmp("profile-set", long_options[option_index].name)) {
+				opt::profile_set = optarg;
+			} else if(!std::strcmp("profile-use", long_options[option_index].name)) {
+				opt::profile_use = optarg;
+			} else if(!std::strcmp("profile-list", long_options[option_index].name)) {
+				opt::profile_list = true;
+			} else if(!std::strcmp("move", long_options[option_index].name)) {
+				opt::override_move = optarg;
+			} else if(!std::strcmp("before", long_options[option_index].name)) {
+				opt::override_move_tgt = optarg;
+				opt::override_move_after = false;
+			} else if(!std::strcmp("after", long_options[option_index].name)) {
+				opt::override_move_tgt = optarg;
+				opt::override_move_after = true;
 			}
 		} break;
 
@@ -162,4 +314,26 @@ int opt::parse_args(int argc, char *argv[], const char *prog, const char *versio
 	return optind;
 }
 
-
+void opt::clear_actions(void) {
+	opt::data_extract = false;
+	opt::sort_plugins = false;
+	opt::override_list = false;
+	opt::override_list_replace = false;
+	opt::override_list_bsa_replace = false;
+	opt::override_list_verify = false;
+	opt::override_list_verify_fast = false;
+	opt::override_list_remove = false;
+	opt::override_redeploy = false;
+	opt::override_move_after = false;
+	opt::override_pack_bsa = false;
+	opt::override_dedup_store = false;
+	opt::profile_list = false;
+	opt::fuse_mount.clear();
+	opt::override_move.clear();
+	opt::override_move_tgt.clear();
+	opt::answers_record.clear();
+	opt::answers_replay.clear();
+	opt::override_deploy_mode.clear();
+	opt::profile_set.clear();
+	opt::profile_use.clear();
+}
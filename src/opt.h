@@ -28,13 +28,38 @@ namespace opt {
 				xml_debug,
 				override_list,
 				override_list_replace,
+				override_list_bsa_replace,
 				override_list_verify,
-				override_list_remove;
+				override_list_verify_fast,
+				override_list_remove,
+				override_redeploy,
+				override_move_after,
+				override_pack_bsa,
+				override_dedup_store,
+				server_daemon,
+				server_remote,
+				profile_list,
+				sort_plugins;
 	extern std::string	skyrim_se_data,
 				skyrim_se_plugins,
-				override_data;
+				override_data,
+				fuse_mount,
+				override_move,
+				override_move_tgt,
+				answers_record,
+				answers_replay,
+				override_deploy_mode,
+				server_socket,
+				profile_set,
+				profile_use;
 
 	extern int parse_args(int argc, char *argv[], const char *prog, const char *version);
+	// clears the options which act once (listings,
+	// installs, removals, moves, sorting, profiles...)
+	// keeping the setup ones (directories, files and
+	// output), the daemon serves each request with
+	// its own
+	extern void clear_actions(void);
 }
 
 #endif //_OPT_H_
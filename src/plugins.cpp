@@ -15,81 +15,129 @@
     along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
  * */
 
+
 #include "plugins.h"
 #include "utils.h"
+#include "esp.h"
 #include <fstream>
-#include <regex>
-#include <set>
+#include <cstdio>
+
+namespace {
+	// plugins names in Plugins.txt may be
+	// prefixed by '*' when enabled
+	std::string plugin_key(const std::string& line) {
+		const auto	l = utils::trim(line);
+		return utils::to_lower((!l.empty() && l[0] == '*') ? l.substr(1) : l);
+	}
+}
+
+plugins::manager::manager(const std::string& plugins_file) : plugins_file_(plugins_file) {
+	std::ifstream	plugins_s(plugins_file_);
+	std::string	line;
+	while(std::getline(plugins_s, line)) {
+		lines_.push_back(line);
+		if(line.empty() || (*line.begin() == '#'))
+			continue;
+		existing_.insert(plugin_key(line));
+	}
+	LOG << "Plugins file '" << plugins_file_ << "' loaded (" << existing_.size() << " plugins)";
+}
 
-void plugins::add_esp_files(const arc::file_names& esp_files, const std::string& basepath, const std::string& plugins_file) {
-	// first of all, clean the list of ESP which are
-	// not installed under proper data directory
-	arc::file_names	r_esp_names;
+void plugins::manager::add_esp_files(const arc::file_names& esp_files, const std::string& basepath) {
 	for(const auto& i : esp_files) {
-		// get file name
+		// first of all, skip the ESP which are
+		// not installed under proper data directory
 		const auto	esp_name = utils::file_name(i);
 		if((basepath + esp_name) != i) {
 			std::stringstream	msg;
 			msg	<< "Discarding '" << i << "' from automated "
 				<< "install, please manually copy and enable it";
 			std::cout << utils::term::yellow(msg.str()) << std::endl;
-		} else {
-			r_esp_names.push_back(esp_name);
-		}
-	}
-	// get the content of the file and create a backup copy
-	std::vector<std::string>	existing_plugins;
-	{
-		std::ifstream	plugins_s(plugins_file);
-		const auto	cur_t = time(NULL);
-		struct tm	cur_tm = {0};
-		localtime_r(&cur_t, &cur_tm);
-		char		cur_t_str[64];
-		std::snprintf(cur_t_str, 64, "%04i%02i%02i-%02i%02i", cur_tm.tm_year+1900, cur_tm.tm_mon+1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min);
-		std::ofstream	plugins_backup(plugins_file + ".backup." + cur_t_str);
-		if(plugins_s) {
-			std::string	line;
-			while(std::getline(plugins_s, line)) {
-				plugins_backup << line << '\n';
-				if(line.empty() || (*line.begin() == '#'))
-					continue;
-				existing_plugins.push_back(line);
-			}
+			continue;
 		}
-	}
-	// now open the file in w mode
-	// and add the plugins, enabling those
-	std::set<std::string>		added_plugins;
-	std::ofstream			plugins_s(plugins_file, std::ios_base::app);
-	if(!plugins_s)
-		throw std::runtime_error(std::string("Can't open plugins file '") + plugins_file + "' for updating it");
-	for(const auto& i : r_esp_names) {
-		// matches any characters that need to be escaped in RegEx
-		const std::regex	special_chars { R"([-[\]{}()*+?.,\^$|#\s])" };
-		const std::string	sanitized = std::regex_replace( i, special_chars, R"(\$&)" );
-		auto fn_find_esp = [&existing_plugins, &sanitized](void) -> bool {
-			const std::regex	esp_regex(sanitized, std::regex_constants::ECMAScript | std::regex_constants::icase);
-			for(const auto& j : existing_plugins) {
-				if(std::regex_search(j, esp_regex))
-					return true;
-			}
-			return false;
-		};
-		if(fn_find_esp()) {
+		const auto	key = utils::to_lower(esp_name);
+		if(existing_.find(key) != existing_.end()) {
 			std::stringstream	msg;
-			msg	<< "Plugin/mod '" << i << "' already in file '"
-				<< plugins_file << "', please manually manage it";
+			msg	<< "Plugin/mod '" << esp_name << "' already in file '"
+				<< plugins_file_ << "', please manually manage it";
 			std::cout << utils::term::yellow(msg.str()) << std::endl;
 			continue;
 		}
-		if(added_plugins.end() != added_plugins.find(i)) {
-			LOG << "ESP '" << i << "' has just been inserted, skipping it";
-			continue;
-		}
 		// now add it to the list
-		added_plugins.insert(i);
-		// a '*' denotes enabled plugin
-		plugins_s << "*" << i << std::endl;
+		existing_.insert(key);
+		added_.push_back(esp_name);
+		LOG << "ESP '" << esp_name << "' to be added to '" << plugins_file_ << "'";
+	}
+}
+
+void plugins::manager::sort_lines(std::vector<std::string>& lines) const {
+	// comments and empty lines stay where they
+	// are, plugins get sorted among their slots
+	std::vector<size_t>		slots;
+	std::vector<std::string>	names;
+	for(size_t i = 0; i < lines.size(); ++i) {
+		const auto	l = utils::trim(lines[i]);
+		if(l.empty() || l[0] == '#')
+			continue;
+		slots.push_back(i);
+		names.push_back((l[0] == '*') ? l.substr(1) : l);
+	}
+	const auto	order = esp::sort(names, esp::scan(sort_data_dir_, names));
+	std::vector<std::string>	sorted;
+	sorted.reserve(order.size());
+	for(const auto& i : order)
+		sorted.push_back(lines[slots[i]]);
+	size_t		n_moved = 0;
+	for(size_t i = 0; i < slots.size(); ++i) {
+		if(lines[slots[i]] != sorted[i])
+			++n_moved;
+		lines[slots[i]] = sorted[i];
+	}
+	LOG << "Load order of " << names.size() << " plugins sorted, " << n_moved << " changed position";
+}
+
+void plugins::manager::sort_load_order(const std::string& data_dir) {
+	sort_data_dir_ = data_dir;
+}
+
+void plugins::manager::commit(void) {
+	std::vector<std::string>	new_lines(lines_);
+	// a '*' denotes enabled plugin
+	for(const auto& i : added_)
+		new_lines.push_back('*' + i);
+	if(!sort_data_dir_.empty())
+		sort_lines(new_lines);
+	if(new_lines == lines_)
+		return;
+	// create a backup copy of the original
+	// content first
+	const auto	cur_t = time(NULL);
+	struct tm	cur_tm = {0};
+	localtime_r(&cur_t, &cur_tm);
+	char		cur_t_str[64];
+	std::snprintf(cur_t_str, 64, "%04i%02i%02i-%02i%02i", cur_tm.tm_year+1900, cur_tm.tm_mon+1, cur_tm.tm_mday, cur_tm.tm_hour, cur_tm.tm_min);
+	{
+		std::ofstream	plugins_backup(plugins_file_ + ".backup." + cur_t_str);
+		for(const auto& l : lines_)
+			plugins_backup << l << '\n';
+	}
+	// then write the new content and rename it
+	// over the original file
+	const std::string	tmp_file = plugins_file_ + ".tmp";
+	{
+		std::ofstream	plugins_s(tmp_file);
+		if(!plugins_s)
+			throw std::runtime_error(std::string("Can't open plugins file '") + tmp_file + "' for updating it");
+		for(const auto& l : new_lines)
+			plugins_s << l << '\n';
+		plugins_s.flush();
+		if(!plugins_s)
+			throw std::runtime_error(std::string("Can't write plugins file '") + tmp_file + "'");
 	}
+	if(std::rename(tmp_file.c_str(), plugins_file_.c_str()))
+		throw std::runtime_error(std::string("Can't update plugins file '") + plugins_file_ + "'");
+	LOG << "Plugins file '" << plugins_file_ << "' updated (" << added_.size() << " plugins added)";
+	lines_.swap(new_lines);
+	added_.clear();
 }
 
@@ -19,9 +19,32 @@
 #define _PLUGINS_H_
 
 #include "arc.h"
+#include <unordered_set>
 
 namespace plugins {
-	extern void add_esp_files(const arc::file_names& esp_files, const std::string& basepath, const std::string& plugins_file);
+	// manages Plugins.txt for a whole run: the file is
+	// read once, additions of all the archives are
+	// collected and written at once by commit(), with
+	// a single backup and an atomic rename
+	class manager {
+		const std::string		plugins_file_;
+		std::vector<std::string>	lines_,
+						added_;
+		std::unordered_set<std::string>	existing_;
+		std::string			sort_data_dir_;
+
+		void sort_lines(std::vector<std::string>& lines) const;
+
+		manager(const manager&) = delete;
+		manager& operator=(const manager&) = delete;
+public:
+		manager(const std::string& plugins_file);
+		void add_esp_files(const arc::file_names& esp_files, const std::string& basepath);
+		// the whole load order will be sorted by commit(),
+		// reading the masters of the plugins under data_dir
+		void sort_load_order(const std::string& data_dir);
+		void commit(void);
+	};
 }
 
 #endif //_PLUGINS_H_
@@ -0,0 +1,215 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "profile.h"
+#include "fsoverlay.h"
+#include "utils.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+
+namespace {
+	const char	*PROFILES_EXT = ".profiles/",
+			*SWAP_EXT = ".skyrim-pm-swap",
+			*LINK_TMP_EXT = ".skyrim-pm-tmp",
+			*STAGE_NAME = ".skyrim-pm-stage";
+
+	std::string no_slash(const std::string& d) {
+		return d.substr(0, d.length()-1);
+	}
+
+	// Data links to its profiles relatively,
+	// <Data>.profiles/<name>
+	std::string link_prefix(const std::string& data_dir) {
+		return utils::file_name(no_slash(data_dir)) + PROFILES_EXT;
+	}
+
+	void swap_data(const std::string& data_dir, const std::string& name) {
+		const std::string	data = no_slash(data_dir),
+					tmp = data + SWAP_EXT;
+		unlink(tmp.c_str());
+		if(symlink((link_prefix(data_dir) + name).c_str(), tmp.c_str()))
+			throw std::runtime_error(std::string("Can't create symlink '") + tmp + "' [" + std::strerror(errno) + "]");
+		if(rename(tmp.c_str(), data.c_str())) {
+			const int	err = errno;
+			unlink(tmp.c_str());
+			throw std::runtime_error(std::string("Can't swap '") + data + "' to profile '" + name + "' [" + std::strerror(err) + "]");
+		}
+	}
+
+	// invokes fn(rel, d_type) for each entry found
+	// under d_name + rel; directories are descended
+	// into when fn returns true
+	void rec_dir(const std::string& d_name, const std::string& rel, const std::function<bool(const std::string&, const unsigned char)>& fn) {
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir((d_name + rel).c_str()), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't open '") + d_name + rel + "' to scan for files");
+		struct dirent	*de = 0;
+		while((de = readdir(d.get()))) {
+			if(!std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+				continue;
+			if(rel.empty() && !std::strcmp(de->d_name, STAGE_NAME))
+				continue;
+			const std::string	cur = rel + de->d_name;
+			if(fn(cur, de->d_type) && DT_DIR == de->d_type)
+				rec_dir(d_name, cur + '/', fn);
+		}
+	}
+
+	void set_link(const std::string& target, const std::string& path) {
+		const std::string	tmp = path + LINK_TMP_EXT;
+		unlink(tmp.c_str());
+		if(symlink(target.c_str(), tmp.c_str()) || rename(tmp.c_str(), path.c_str()))
+			throw std::runtime_error(std::string("Can't create symlink '") + path + "' --> '" + target + "' [" + std::strerror(errno) + "]");
+	}
+}
+
+std::string profile::dir(const std::string& data_dir) {
+	return no_slash(data_dir) + PROFILES_EXT;
+}
+
+std::string profile::active(const std::string& data_dir) {
+	char		buf[PATH_MAX];
+	const ssize_t	sz = readlink(no_slash(data_dir).c_str(), buf, sizeof(buf)-1);
+	if(sz == -1)
+		return "";
+	buf[sz] = '\0';
+	const std::string	tgt(buf),
+				prefix = link_prefix(data_dir);
+	if(tgt.compare(0, prefix.length(), prefix))
+		return "";
+	return tgt.substr(prefix.length());
+}
+
+std::string profile::base_dir(const std::string& data_dir) {
+	if(active(data_dir).empty())
+		return data_dir;
+	return dir(data_dir) + fso::DEFAULT_PROFILE + '/';
+}
+
+void profile::init(std::ostream& ostr, const std::string& data_dir) {
+	const std::string	data = no_slash(data_dir),
+				def = dir(data_dir) + fso::DEFAULT_PROFILE;
+	struct stat		st;
+	if(lstat(data.c_str(), &st))
+		throw std::runtime_error(std::string("Can't find '") + data + "'");
+	if(S_ISLNK(st.st_mode)) {
+		if(active(data_dir).empty())
+			throw std::runtime_error(std::string("'") + data + "' is a symlink not managed by skyrim-pm, can't use profiles");
+		return;
+	}
+	if(mkdir(dir(data_dir).c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) && errno != EEXIST)
+		throw std::runtime_error(std::string("Can't create profiles directory '") + dir(data_dir) + "'");
+	if(!lstat(def.c_str(), &st))
+		throw std::runtime_error(std::string("Default profile '") + def + "' already exists, can't move Data there");
+	if(rename(data.c_str(), def.c_str()))
+		throw std::runtime_error(std::string("Can't move '") + data + "' to '" + def + "' [" + std::strerror(errno) + "]");
+	swap_data(data_dir, fso::DEFAULT_PROFILE);
+	ostr << utils::term::yellow(std::string("Moved '") + data + "' to '" + def + "', now a symlink to it") << std::endl;
+}
+
+void profile::build(std::ostream& ostr, const std::string& data_dir, const std::string& name) {
+	if(name == fso::DEFAULT_PROFILE)
+		return;
+	const std::string	base = dir(data_dir) + fso::DEFAULT_PROFILE + '/',
+				farm = dir(data_dir) + name + '/';
+	// what the farm has to look like: the links to the
+	// files of Data not managed by the overlay and to
+	// the winning files among the profile plugins
+	fso::winner_map		all,
+				wins;
+	const auto		p_names = fso::get_profile(name);
+	fso::resolve(all);
+	fso::resolve(wins, &p_names);
+	std::unordered_map<std::string, std::string>	links;
+	std::unordered_set<std::string>			dirs;
+	rec_dir(base, "", [&](const std::string& rel, const unsigned char d_type) -> bool {
+		if(DT_DIR == d_type) {
+			dirs.insert(rel);
+		} else if(all.find(rel) == all.end()) {
+			links[rel] = base + rel;
+		}
+		return true;
+	});
+	for(const auto& w : wins) {
+		links[w.first] = w.second.r_file;
+		for(auto p_slash = w.first.find('/'); p_slash != std::string::npos; p_slash = w.first.find('/', p_slash+1))
+			dirs.insert(w.first.substr(0, p_slash));
+	}
+	// then only fix what differs in the current one
+	size_t	n_same = 0,
+		n_changed = 0,
+		n_removed = 0;
+	if(mkdir(farm.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) && errno != EEXIST)
+		throw std::runtime_error(std::string("Can't create profile directory '") + farm + "'");
+	rec_dir(farm, "", [&](const std::string& rel, const unsigned char d_type) -> bool {
+		const std::string	path = farm + rel;
+		if(DT_DIR == d_type) {
+			if(dirs.erase(rel))
+				return true;
+			utils::remove_tree(path);
+			++n_removed;
+			return false;
+		}
+		const auto	it = links.find(rel);
+		if(it == links.end()) {
+			LOG << "Profile '" << name << "' stale link '" << path << "' removed";
+			unlink(path.c_str());
+			++n_removed;
+			return false;
+		}
+		char		r_file[PATH_MAX];
+		const ssize_t	r_sz = (DT_LNK == d_type) ? readlink(path.c_str(), r_file, sizeof(r_file)-1) : -1;
+		if(r_sz != -1 && it->second.compare(0, std::string::npos, r_file, r_sz) == 0) {
+			++n_same;
+		} else {
+			LOG << "Profile '" << name << "' link '" << path << "' --> '" << it->second << "'";
+			set_link(it->second, path);
+			++n_changed;
+		}
+		links.erase(it);
+		return false;
+	});
+	for(const auto& d : dirs)
+		utils::ensure_fname_path(farm + d + '/');
+	for(const auto& l : links) {
+		const std::string	path = farm + l.first;
+		utils::ensure_fname_path(path);
+		if(symlink(l.second.c_str(), path.c_str()))
+			throw std::runtime_error(std::string("Can't create symlink '") + path + "' --> '" + l.second + "' [" + std::strerror(errno) + "]");
+	}
+	ostr	<< "Profile '" << name << "' built: " << n_same << " links unchanged, " << links.size() << " added, "
+		<< n_changed << " changed, " << n_removed << " removed" << std::endl;
+}
+
+void profile::activate(std::ostream& ostr, const std::string& data_dir, const std::string& name) {
+	struct stat	st;
+	if(stat((dir(data_dir) + name).c_str(), &st) || !S_ISDIR(st.st_mode))
+		throw std::runtime_error(std::string("Profile '") + name + "' has not been built");
+	swap_data(data_dir, name);
+	ostr << utils::term::green(std::string("Profile '") + name + "' active") << std::endl;
+}
@@ -0,0 +1,53 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <string>
+#include <ostream>
+
+namespace profile {
+	// the profiles live next to Data, each one in
+	// <Data>.profiles/<name>/; once in use, Data is a
+	// symlink to one of them and the original Data
+	// directory is the default profile (all plugins).
+	// All the paths are '/' terminated
+	extern std::string dir(const std::string& data_dir);
+	// name of the profile Data points to, empty when
+	// Data is still a plain directory
+	extern std::string active(const std::string& data_dir);
+	// directory holding the content of Data
+	// as installed, Data itself until moved
+	extern std::string base_dir(const std::string& data_dir);
+	// moves Data to the default profile, replacing it
+	// with a symlink to it, unless already done
+	extern void init(std::ostream& ostr, const std::string& data_dir);
+	// builds the symlink farm of a profile: a link to
+	// each file of the default profile not deployed
+	// from the override directory and one to each file
+	// won by the plugins of the profile; an existing
+	// farm is updated changing only the links which
+	// differ. The default profile isn't touched
+	extern void build(std::ostream& ostr, const std::string& data_dir, const std::string& name);
+	// points Data to a (built) profile by renaming
+	// a new symlink over it
+	extern void activate(std::ostream& ostr, const std::string& data_dir, const std::string& name);
+}
+
+#endif //_PROFILE_H_
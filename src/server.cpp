@@ -0,0 +1,316 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "server.h"
+#include "utils.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+namespace {
+	// a request is a 32 bit length followed by the
+	// working directory and the arguments, all '\0'
+	// terminated; the client stdin, stdout and stderr
+	// travel along the first chunk (SCM_RIGHTS). The
+	// reply is the 32 bit exit code of the request
+	const int		N_FDS = 3;
+
+	volatile sig_atomic_t	stop_serving = 0;
+
+	void on_stop(int) {
+		stop_serving = 1;
+	}
+
+	// failing to update the server state must not
+	// stop it, the next requests reload what they need
+	void guarded(const char* what, const std::function<void(void)>& fn) {
+		try {
+			fn();
+		} catch(const std::exception& e) {
+			std::cerr << utils::term::dim("Exception: ") << utils::term::red(std::string(what) + ", " + e.what()) << std::endl;
+		} catch(...) {
+			std::cerr << utils::term::red(std::string(what) + ", unknown exception") << std::endl;
+		}
+	}
+
+	sockaddr_un make_addr(const std::string& sock) {
+		sockaddr_un	addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(sock.length() >= sizeof(addr.sun_path))
+			throw std::runtime_error(std::string("Socket path '") + sock + "' is too long");
+		std::strcpy(addr.sun_path, sock.c_str());
+		return addr;
+	}
+
+	bool read_all(const int fd, void* p, size_t sz) {
+		uint8_t	*b = (uint8_t*)p;
+		while(sz) {
+			const ssize_t	rd = read(fd, b, sz);
+			if(rd < 0 && errno == EINTR)
+				continue;
+			if(rd <= 0)
+				return false;
+			b += rd;
+			sz -= rd;
+		}
+		return true;
+	}
+
+	bool write_all(const int fd, const void* p, size_t sz) {
+		const uint8_t	*b = (const uint8_t*)p;
+		while(sz) {
+			const ssize_t	wr = send(fd, b, sz, MSG_NOSIGNAL);
+			if(wr < 0 && errno == EINTR)
+				continue;
+			if(wr <= 0)
+				return false;
+			b += wr;
+			sz -= wr;
+		}
+		return true;
+	}
+
+	// receives the header with the client fds and
+	// then the payload; returns false on bad requests
+	bool recv_request(const int c, int (&fds)[N_FDS], std::vector<char>& payload) {
+		uint32_t	len = 0;
+		char		cbuf[CMSG_SPACE(sizeof(int)*N_FDS)];
+		iovec		iov = { &len, sizeof(len) };
+		msghdr		msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+		// whatever fds came along a malformed
+		// request are closed, not leaked
+		const auto	fn_close_all = [&msg]() -> bool {
+			for(cmsghdr *m = CMSG_FIRSTHDR(&msg); m; m = CMSG_NXTHDR(&msg, m)) {
+				if(m->cmsg_level != SOL_SOCKET || m->cmsg_type != SCM_RIGHTS)
+					continue;
+				const size_t	n = (m->cmsg_len - CMSG_LEN(0))/sizeof(int);
+				for(size_t i = 0; i < n; ++i) {
+					int	f = -1;
+					std::memcpy(&f, CMSG_DATA(m) + i*sizeof(int), sizeof(int));
+					close(f);
+				}
+			}
+			return false;
+		};
+		const ssize_t	rv = recvmsg(c, &msg, MSG_CMSG_CLOEXEC);
+		if(rv == -1)
+			return false;
+		if(rv != sizeof(len) || (msg.msg_flags & MSG_CTRUNC))
+			return fn_close_all();
+		const cmsghdr	*cm = CMSG_FIRSTHDR(&msg);
+		if(!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(int)*N_FDS) || CMSG_NXTHDR(&msg, const_cast<cmsghdr*>(cm)))
+			return fn_close_all();
+		std::memcpy(fds, CMSG_DATA(cm), sizeof(int)*N_FDS);
+		if(!len || len > 1024*1024)
+			return fn_close_all();
+		payload.resize(len);
+		if(!read_all(c, &payload[0], len) || payload.back() != '\0')
+			return fn_close_all();
+		return true;
+	}
+
+	// in the forked child: becomes the client
+	// and runs the request
+	int run_request(const int (&fds)[N_FDS], const std::vector<char>& payload, const server::handler& run_fn, server::outcome& out) {
+		for(int i = 0; i < N_FDS; ++i) {
+			if(dup2(fds[i], i) == -1)
+				return 1;
+			close(fds[i]);
+		}
+		std::vector<char*>	args;
+		for(size_t i = 0; i < payload.size(); i += std::strlen(&payload[i]) + 1)
+			args.push_back(const_cast<char*>(&payload[i]));
+		if(args.size() < 2 || chdir(args[0]))
+			return 1;
+		args.push_back(0);
+		try {
+			return run_fn(args.size() - 2, &args[1], out);
+		} catch(const std::exception& e) {
+			std::cerr << utils::term::dim("Exception: ") << utils::term::red(e.what()) << std::endl;
+		} catch(...) {
+			std::cerr << utils::term::red("Unknown exception") << std::endl;
+		}
+		return 1;
+	}
+}
+
+std::string server::default_socket(void) {
+	const char	*rt = std::getenv("XDG_RUNTIME_DIR");
+	if(rt && *rt)
+		return std::string(rt) + "/skyrim-pm.sock";
+	return std::string("/tmp/skyrim-pm-") + std::to_string(getuid()) + ".sock";
+}
+
+void server::serve(const std::string& sock, const handler& run_fn, const std::function<void(const outcome&)>& refresh_fn, const poll_fd& extra) {
+	const auto	addr = make_addr(sock);
+	const int	s = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if(s == -1)
+		throw std::runtime_error("Can't create unix socket");
+	// a socket file left by a dead server
+	// gets replaced, a live one is an error
+	if(!connect(s, (const sockaddr*)&addr, sizeof(addr))) {
+		close(s);
+		throw std::runtime_error(std::string("A server is already listening on '") + sock + "'");
+	}
+	unlink(sock.c_str());
+	// only the user can connect
+	const mode_t	prev_mask = umask(0077);
+	const int	rv = bind(s, (const sockaddr*)&addr, sizeof(addr));
+	umask(prev_mask);
+	if(rv || listen(s, 16)) {
+		close(s);
+		throw std::runtime_error(std::string("Can't listen on '") + sock + "' [" + std::strerror(errno) + "]");
+	}
+	// no SA_RESTART, so that accept gets interrupted
+	struct sigaction	sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_stop;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	std::cout << utils::term::green(std::string("Serving requests on '") + sock + "'") << std::endl;
+	while(!stop_serving) {
+		pollfd	pfd[2] = { { s, POLLIN, 0 }, { extra.fd, POLLIN, 0 } };
+		const int	n_ready = poll(pfd, (extra.fd == -1) ? 1 : 2, 1000);
+		if(n_ready == -1)
+			continue;
+		if(extra.fd != -1 && (!n_ready || (pfd[1].revents & POLLIN)))
+			guarded("Can't process watched fd", [&extra]() { extra.on_ready(false); });
+		if(!(pfd[0].revents & POLLIN))
+			continue;
+		const int	c = accept4(s, 0, 0, SOCK_CLOEXEC);
+		if(c == -1)
+			continue;
+		int			fds[N_FDS];
+		std::vector<char>	payload;
+		ucred			cr;
+		socklen_t		cr_len = sizeof(cr);
+		if(getsockopt(c, SOL_SOCKET, SO_PEERCRED, &cr, &cr_len) || cr.uid != getuid() || !recv_request(c, fds, payload)) {
+			LOG << "Invalid request, dropped";
+			close(c);
+			continue;
+		}
+		if(extra.fd != -1)
+			guarded("Can't process watched fd", [&extra]() { extra.on_ready(true); });
+		// the child reports the outcome
+		// through a pipe
+		int	p[2];
+		if(pipe2(p, O_CLOEXEC)) {
+			for(const auto& f : fds)
+				close(f);
+			close(c);
+			continue;
+		}
+		const pid_t	pid = fork();
+		if(pid == 0) {
+			close(s);
+			close(c);
+			close(p[0]);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			outcome		out = { false, false };
+			const int	code = run_request(fds, payload, run_fn, out);
+			std::cout.flush();
+			std::cerr.flush();
+			if(write(p[1], &out, sizeof(out))) {}
+			_exit(code);
+		}
+		for(const auto& f : fds)
+			close(f);
+		close(p[1]);
+		outcome		out = { false, false };
+		int		status = 0;
+		// a request which didn't report may
+		// have changed anything
+		if(pid <= 0 || !read_all(p[0], &out, sizeof(out)))
+			out = { pid > 0, false };
+		close(p[0]);
+		while(pid > 0 && waitpid(pid, &status, 0) == -1 && errno == EINTR);
+		const int32_t	code = (pid > 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : 1;
+		write_all(c, &code, sizeof(code));
+		close(c);
+		LOG << "Request served, exit code " << code << (out.changed ? ", state changed" : "") << (out.synced ? ", overlay in sync" : "");
+		guarded("Can't refresh after request", [&refresh_fn, &out]() { refresh_fn(out); });
+	}
+	close(s);
+	unlink(sock.c_str());
+	std::cout << utils::term::blue("Server stopped") << std::endl;
+}
+
+int server::forward(const std::string& sock, int argc, char *argv[]) {
+	const auto	addr = make_addr(sock);
+	const int	s = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if(s == -1)
+		throw std::runtime_error("Can't create unix socket");
+	if(connect(s, (const sockaddr*)&addr, sizeof(addr))) {
+		close(s);
+		throw std::runtime_error(std::string("Can't connect to server on '") + sock + "', is 'skyrim-pm --daemon' running?");
+	}
+	char	cwd[PATH_MAX];
+	if(!getcwd(cwd, PATH_MAX)) {
+		close(s);
+		throw std::runtime_error("Can't get current directory");
+	}
+	std::string	payload(cwd);
+	payload += '\0';
+	for(int i = 0; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--remote"))
+			continue;
+		payload += argv[i];
+		payload += '\0';
+	}
+	uint32_t	len = payload.size();
+	const int	fds[N_FDS] = { 0, 1, 2 };
+	char		cbuf[CMSG_SPACE(sizeof(fds))];
+	std::memset(cbuf, 0, sizeof(cbuf));
+	iovec		iov = { &len, sizeof(len) };
+	msghdr		msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsghdr	*cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	std::memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	int32_t	code = 1;
+	const bool	ok = (sendmsg(s, &msg, MSG_NOSIGNAL) == sizeof(len)) && write_all(s, payload.c_str(), payload.size()) && read_all(s, &code, sizeof(code));
+	close(s);
+	if(!ok)
+		throw std::runtime_error(std::string("Request to server on '") + sock + "' failed");
+	return code;
+}
@@ -0,0 +1,64 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <string>
+#include <functional>
+
+namespace server {
+	// what a request did, for the server to update
+	// its state: 'changed' when Data, the overlay
+	// config or Plugins.txt got modified, 'synced'
+	// when the overlay was found correctly deployed
+	// (verified or redeployed)
+	struct outcome {
+		bool	changed,
+			synced;
+	};
+
+	// runs a request (argv as from the command line)
+	typedef std::function<int(int argc, char *argv[], outcome& out)>	handler;
+
+	// an extra fd (i.e. inotify) for the server to poll
+	// along the socket: on_ready gets called when it's
+	// readable, once a second while idle and right
+	// before each request ('request' set); fd is read
+	// again at each iteration, refresh_fn may change it
+	struct poll_fd {
+		int					fd;
+		std::function<void(const bool request)>	on_ready;
+	};
+
+	// $XDG_RUNTIME_DIR/skyrim-pm.sock, or a per user
+	// socket under /tmp
+	extern std::string default_socket(void);
+	// serves the requests sent with forward() on the
+	// unix socket sock, one at a time, until SIGINT or
+	// SIGTERM: each runs in a child forked from the
+	// warm process, with the stdin/stdout/stderr and
+	// the working directory of the client; refresh_fn
+	// is then called in the server with its outcome
+	extern void serve(const std::string& sock, const handler& run_fn, const std::function<void(const outcome&)>& refresh_fn, const poll_fd& extra = {-1, nullptr});
+	// sends the command line (but --remote) to the
+	// server, returns the request exit code
+	extern int forward(const std::string& sock, int argc, char *argv[]);
+}
+
+#endif //_SERVER_H_
@@ -0,0 +1,87 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "stage.h"
+#include "utils.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+	const char	*STAGE_DIR = ".skyrim-pm-stage/";
+
+	void make_stage_dir(const std::string& d) {
+		// leftovers of an interrupted run
+		utils::remove_tree(d);
+		if(mkdir(d.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH))
+			throw std::runtime_error(std::string("Can't create staging directory '") + d + "'");
+	}
+}
+
+stage::install::install(const std::string& data_dir, const std::string& ovd_dir) : data_dir_(data_dir), ovd_dir_(ovd_dir), data_stage_(data_dir + STAGE_DIR),
+										   ovd_stage_(ovd_dir.empty() ? "" : ovd_dir + STAGE_DIR), committed_(false) {
+	make_stage_dir(data_stage_);
+	if(!ovd_stage_.empty())
+		make_stage_dir(ovd_stage_);
+}
+
+std::string stage::install::staged(const std::string& p) const {
+	// the longest matching directory first, in
+	// case one is under the other
+	const bool	ovd_first = ovd_dir_.length() > data_dir_.length();
+	for(int i = 0; i < 2; ++i) {
+		const bool		is_ovd = (i == 0) == ovd_first;
+		const std::string&	dir = is_ovd ? ovd_dir_ : data_dir_;
+		if(!dir.empty() && !p.compare(0, dir.length(), dir))
+			return (is_ovd ? ovd_stage_ : data_stage_) + p.substr(dir.length());
+	}
+	throw std::runtime_error(std::string("Path '") + p + "' can't be staged");
+}
+
+void stage::install::commit(const std::string& xml_tmp, const std::string& xml) {
+	// all the conflicts are found before the
+	// first rename, the install is then either
+	// refused as a whole or moved in place
+	try {
+		if(!ovd_stage_.empty())
+			utils::merge_tree(ovd_stage_, ovd_dir_, true);
+		utils::merge_tree(data_stage_, data_dir_, true);
+	} catch(...) {
+		if(!xml_tmp.empty())
+			std::remove(xml_tmp.c_str());
+		throw;
+	}
+	// real files first, so that the symlinks
+	// in Data never point to missing ones
+	if(!ovd_stage_.empty())
+		utils::merge_tree(ovd_stage_, ovd_dir_);
+	utils::merge_tree(data_stage_, data_dir_);
+	if(!xml_tmp.empty() && std::rename(xml_tmp.c_str(), xml.c_str()))
+		throw std::runtime_error(std::string("Can't rename '") + xml_tmp + "' to '" + xml + "'");
+	committed_ = true;
+	LOG << "Install committed into '" << data_dir_ << "'";
+}
+
+stage::install::~install() {
+	if(!committed_)
+		LOG << "Install not committed, removing staging directories";
+	utils::remove_tree(data_stage_);
+	if(!ovd_stage_.empty())
+		utils::remove_tree(ovd_stage_);
+}
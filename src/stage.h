@@ -0,0 +1,60 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _STAGE_H_
+#define _STAGE_H_
+
+#include <string>
+
+namespace stage {
+	// stages the install of a plugin: all the files and
+	// symlinks get written under staging directories on
+	// the same filesystem of Data (and of the override
+	// directory), then moved in place by commit() with
+	// renames only; unless committed, the staging
+	// directories get removed, leaving Data untouched
+	class install {
+		const std::string	data_dir_,
+					ovd_dir_,
+					data_stage_,
+					ovd_stage_;
+		bool			committed_;
+
+		install(const install&) = delete;
+		install& operator=(const install&) = delete;
+public:
+		// both directories are '/' terminated, ovd_dir
+		// (override directory) can be empty
+		install(const std::string& data_dir, const std::string& ovd_dir);
+		// maps a path under Data or the override
+		// directory to the staged one
+		std::string staged(const std::string& p) const;
+		// moves the staged override files and then Data
+		// entries in place, then renames xml_tmp over xml
+		// (the overlay config) if set. The staged trees are
+		// checked first: on a conflict (i.e. a file where
+		// Data has a directory) or an unwritable directory
+		// it throws with Data and the override directory
+		// untouched; only an I/O error while renaming can
+		// leave the install partially moved in place
+		void commit(const std::string& xml_tmp = "", const std::string& xml = "");
+		~install();
+	};
+}
+
+#endif //_STAGE_H_
@@ -0,0 +1,201 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "store.h"
+#include "utils.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+	const char		*STORE_DIR = ".store/";
+
+	std::atomic<uint64_t>	tmp_cnt(0);
+
+	// SHA-256 (FIPS 180-4) round constants
+	const uint32_t		K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	inline uint32_t rotr(const uint32_t x, const int n) {
+		return (x >> n) | (x << (32 - n));
+	}
+
+	// blobs are spread over 256 directories
+	// by the first byte of the hash
+	std::string blob_path(const std::string& store_dir, const std::string& h) {
+		return store_dir + h.substr(0, 2) + '/' + h;
+	}
+
+	bool exists(const std::string& f) {
+		struct stat	s = {0};
+		return !lstat(f.c_str(), &s);
+	}
+}
+
+std::string store::dir(const std::string& ovd_dir) {
+	return ovd_dir + STORE_DIR;
+}
+
+void store::writer::block(const uint8_t* p) {
+	uint32_t	w[64];
+	for(int i = 0; i < 16; ++i)
+		w[i] = (uint32_t(p[i*4]) << 24) | (uint32_t(p[i*4+1]) << 16) | (uint32_t(p[i*4+2]) << 8) | p[i*4+3];
+	for(int i = 16; i < 64; ++i) {
+		const uint32_t	s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3),
+				s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+	uint32_t	a = h_[0], b = h_[1], c = h_[2], d = h_[3],
+			e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+	for(int i = 0; i < 64; ++i) {
+		const uint32_t	t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i],
+				t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d;
+	h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+}
+
+std::string store::writer::digest(void) {
+	// padding: 0x80, zeros and the
+	// length in bits (big endian)
+	const uint64_t	bits = len_ * 8;
+	size_t		used = len_ % 64;
+	buf_[used++] = 0x80;
+	if(used > 56) {
+		std::memset(buf_ + used, 0, 64 - used);
+		block(buf_);
+		used = 0;
+	}
+	std::memset(buf_ + used, 0, 56 - used);
+	for(int i = 0; i < 8; ++i)
+		buf_[56 + i] = (bits >> (56 - i*8)) & 0xFF;
+	block(buf_);
+	char	out[65];
+	for(int i = 0; i < 8; ++i)
+		std::sprintf(out + i*8, "%08x", h_[i]);
+	return out;
+}
+
+store::writer::writer(const std::string& new_dir) : tmp_(new_dir + "tmp." + std::to_string(getpid()) + '.' + std::to_string(tmp_cnt++)), len_(0) {
+	static const uint32_t	H0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	std::memcpy(h_, H0, sizeof(h_));
+	utils::ensure_fname_path(tmp_);
+	ostr_.open(tmp_.c_str(), std::ios_base::binary);
+	if(!ostr_)
+		throw std::runtime_error(std::string("Can't create store file '") + tmp_ + "'");
+}
+
+void store::writer::write(const char* p, const size_t sz) {
+	ostr_.write(p, sz);
+	const uint8_t	*u = (const uint8_t*)p;
+	size_t		rem = sz,
+			used = len_ % 64;
+	len_ += sz;
+	// fill the pending block first, then
+	// hash in place as much as possible
+	if(used) {
+		const size_t	n = std::min(rem, 64 - used);
+		std::memcpy(buf_ + used, u, n);
+		u += n;
+		rem -= n;
+		if(used + n < 64)
+			return;
+		block(buf_);
+	}
+	for(; rem >= 64; u += 64, rem -= 64)
+		block(u);
+	std::memcpy(buf_, u, rem);
+}
+
+std::string store::writer::commit(const std::string& store_dir, const std::string& new_dir) {
+	ostr_.close();
+	if(!ostr_)
+		throw std::runtime_error(std::string("Can't write store file '") + tmp_ + "'");
+	const auto	h = digest(),
+			cur = blob_path(store_dir, h),
+			nb = blob_path(new_dir, h);
+	if(exists(cur))
+		return cur;
+	if(!exists(nb)) {
+		// all the files sharing a blob would see
+		// an edit in place, it can't be written
+		if(chmod(tmp_.c_str(), S_IRUSR|S_IRGRP|S_IROTH))
+			throw std::runtime_error(std::string("Can't make store file '") + tmp_ + "' read-only");
+		utils::ensure_fname_path(nb);
+		if(std::rename(tmp_.c_str(), nb.c_str()))
+			throw std::runtime_error(std::string("Can't rename '") + tmp_ + "' to '" + nb + "'");
+	}
+	return nb;
+}
+
+store::writer::~writer() {
+	// no-op when renamed into the store
+	unlink(tmp_.c_str());
+}
+
+size_t store::gc(const std::string& store_dir, const std::unordered_set<ino_t>& inodes) {
+	if(inodes.empty())
+		return 0;
+	size_t					rv = 0;
+	std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(store_dir.c_str()), closedir);
+	if(!d)
+		return 0;
+	struct dirent	*de = 0;
+	while((de = readdir(d.get()))) {
+		if(DT_DIR != de->d_type || de->d_name[0] == '.')
+			continue;
+		const std::string			sub = store_dir + de->d_name;
+		std::unique_ptr<DIR, int(*)(DIR*)>	sd(opendir(sub.c_str()), closedir);
+		if(!sd)
+			continue;
+		// the inode comes with the directory entry,
+		// only the candidates get a stat
+		struct dirent	*sde = 0;
+		while((sde = readdir(sd.get()))) {
+			if(DT_REG != sde->d_type || !inodes.count(sde->d_ino))
+				continue;
+			struct stat	s = {0};
+			if(fstatat(dirfd(sd.get()), sde->d_name, &s, AT_SYMLINK_NOFOLLOW) || s.st_nlink > 1)
+				continue;
+			if(!unlinkat(dirfd(sd.get()), sde->d_name, 0))
+				++rv;
+		}
+		sd.reset();
+		// drop the directory when left empty
+		rmdir(sub.c_str());
+	}
+	LOG << "Store '" << store_dir << "': removed " << rv << " unreferenced blobs";
+	return rv;
+}
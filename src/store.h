@@ -0,0 +1,70 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _STORE_H_
+#define _STORE_H_
+
+#include <string>
+#include <fstream>
+#include <unordered_set>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace store {
+	// content addressed store of the override files,
+	// under <override dir>/.store: each content is saved
+	// once as a blob named by its SHA-256 and the files
+	// of the plugins are hard links to it, hence the
+	// link count of a blob is its reference count;
+	// blobs are read-only as they're shared
+	extern std::string dir(const std::string& ovd_dir);
+
+	// receives the content of a file while it streams
+	// out of the archive, hashing it on the way
+	class writer {
+		std::string	tmp_;
+		std::ofstream	ostr_;
+		uint32_t	h_[8];
+		uint8_t		buf_[64];
+		uint64_t	len_;
+
+		void block(const uint8_t* p);
+		std::string digest(void);
+
+		writer(const writer&) = delete;
+		writer& operator=(const writer&) = delete;
+public:
+		// the content is written to a temporary
+		// file under new_dir
+		writer(const std::string& new_dir);
+		void write(const char* p, const size_t sz);
+		// returns the path of the blob holding the
+		// content: the one already in store_dir (or
+		// in new_dir) if any, otherwise the temporary
+		// file becomes a new blob in new_dir
+		std::string commit(const std::string& store_dir, const std::string& new_dir);
+		~writer();
+	};
+
+	// removes the blobs of store_dir among 'inodes'
+	// which are not referenced anymore, returns
+	// how many got removed
+	extern size_t gc(const std::string& store_dir, const std::unordered_set<ino_t>& inodes);
+}
+
+#endif //_STORE_H_
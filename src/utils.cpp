@@ -17,13 +17,27 @@
 
 #include "utils.h"
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <cstring>
+#include <cerrno>
 #include <stdexcept>
 #include <algorithm>
 #include <sstream>
 #include <chrono>
 #include <memory>
 #include <cstdio>
+#include <fstream>
+#include <climits>
 #include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 #include "opt.h"
 
 /*
@@ -50,23 +64,186 @@ namespace {
 		return tm_buf;
 	}
 
-	std::string exec(const char* cmd) {
-		const static size_t			buf_sz = 256;
-		char					buf[buf_sz];
-		std::stringstream			res;
-		std::unique_ptr<FILE, int(*)(FILE*)>	pipe(popen(cmd, "r"), pclose);
+	// Skyrim SE Steam app id, used for the
+	// Proton prefix under compatdata
+	const char	*SKYRIM_SE_APPID = "489830",
+			*SKYRIM_SE_DIR = "steamapps/common/Skyrim Special Edition",
+			*CACHE_DATA = "data",
+			*CACHE_PLUGINS = "plugins";
 
-		if (!pipe) {
-			throw std::runtime_error("popen failed");
+	bool path_exists(const std::string& p) {
+		struct stat	s = {0};
+		return !stat(p.c_str(), &s);
+	}
+
+	std::string home_dir(void) {
+		const char	*h = getenv("HOME");
+		return h ? h : "";
+	}
+
+	// small cache of the discovered paths, one
+	// 'key=value' per line
+	std::string cache_file(void) {
+		const char	*xdg = getenv("XDG_CONFIG_HOME");
+		const auto	base = (xdg && *xdg) ? std::string(xdg) : home_dir() + "/.config";
+		return base + "/skyrim-pm/paths.conf";
+	}
+
+	std::string cache_get(const std::string& key) {
+		std::ifstream	istr(cache_file());
+		std::string	line;
+		while(std::getline(istr, line)) {
+			if(!line.compare(0, key.length() + 1, key + '='))
+				return line.substr(key.length() + 1);
 		}
+		return "";
+	}
 
-		size_t			rb = 0;
-		while((rb = fread(buf, 1, buf_sz, pipe.get())) > 0) {
-			res.write(buf, rb);
+	void cache_set(const std::string& key, const std::string& value) {
+		const auto			f = cache_file();
+		std::vector<std::string>	lines;
+		{
+			std::ifstream	istr(f);
+			std::string	line;
+			while(std::getline(istr, line)) {
+				if(line.compare(0, key.length() + 1, key + '='))
+					lines.push_back(line);
+			}
 		}
+		lines.push_back(key + '=' + value);
+		try {
+			utils::ensure_fname_path(f);
+		} catch(const std::exception&) {
+			LOG << "Can't create cache directory for '" << f << "'";
+			return;
+		}
+		std::ofstream	ostr(f, std::ios_base::trunc);
+		for(const auto& l : lines)
+			ostr << l << '\n';
+	}
+
+	// returns all the quoted strings of a vdf
+	// (Valve KeyValues) file, in order
+	std::vector<std::string> vdf_tokens(const std::string& f) {
+		std::ifstream			istr(f);
+		std::vector<std::string>	rv;
+		std::string			cur;
+		bool				in_str = false;
+		char				c = 0;
+		while(istr.get(c)) {
+			if(!in_str) {
+				if(c == '"') {
+					in_str = true;
+					cur.clear();
+				}
+			} else if(c == '\\') {
+				if(istr.get(c))
+					cur += c;
+			} else if(c == '"') {
+				in_str = false;
+				rv.push_back(cur);
+			} else cur += c;
+		}
+		return rv;
+	}
+
+	// Steam library folders: the Steam roots
+	// themselves and what libraryfolders.vdf lists,
+	// either as '"path" "<dir>"' or, in older
+	// versions, as '"<n>" "<dir>"'
+	std::vector<std::string> steam_libraries(void) {
+		const auto			home = home_dir();
+		const std::string		roots[] = {
+			home + "/.steam/steam",
+			home + "/.local/share/Steam",
+			home + "/.var/app/com.valvesoftware.Steam/.local/share/Steam"
+		};
+		std::vector<std::string>	rv;
+		const auto			add_lib = [&rv](const std::string& l) -> void {
+			char	r_path[PATH_MAX];
+			if(!realpath(l.c_str(), r_path))
+				return;
+			if(std::find(rv.begin(), rv.end(), r_path) == rv.end())
+				rv.push_back(r_path);
+		};
+		for(const auto& r : roots) {
+			add_lib(r);
+			const auto	tokens = vdf_tokens(r + "/steamapps/libraryfolders.vdf");
+			for(size_t i = 0; i + 1 < tokens.size(); ++i) {
+				const auto&	t = tokens[i];
+				if(utils::to_lower(t) == "path" ||
+				   (!t.empty() && t.find_first_not_of("0123456789") == std::string::npos && tokens[i+1][0] == '/'))
+					add_lib(tokens[i+1]);
+			}
+		}
+		return rv;
+	}
 
-		return res.str();
+	// merges directory src_fd into dst_fd (dst_name
+	// is only used for errors); each entry missing in
+	// dst is a single rename, no matter its size
+	void merge_dir_fd(const int src_fd, const int dst_fd, const std::string& dst_name, const bool check_only) {
+		std::unique_ptr<DIR, int(*)(DIR*)>	d(fdopendir(dup(src_fd)), closedir);
+		if(!d)
+			throw std::runtime_error(std::string("Can't scan staging directory for '") + dst_name + "'");
+		std::vector<std::string>	names;
+		struct dirent			*de = 0;
+		while((de = readdir(d.get()))) {
+			if(strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+				names.push_back(de->d_name);
+		}
+		if(check_only && !names.empty() && faccessat(dst_fd, ".", W_OK, AT_EACCESS))
+			throw std::runtime_error(std::string("Can't write into '") + dst_name + "'");
+		for(const auto& n : names) {
+			if(!check_only) {
+				if(!renameat2(src_fd, n.c_str(), dst_fd, n.c_str(), RENAME_NOREPLACE))
+					continue;
+				if(errno != EEXIST)
+					throw std::runtime_error(std::string("Can't move '") + n + "' into '" + dst_name + "'");
+			}
+			struct stat	src_s = {0},
+					dst_s = {0};
+			if(fstatat(src_fd, n.c_str(), &src_s, AT_SYMLINK_NOFOLLOW))
+				throw std::runtime_error(std::string("Can't stat '") + n + "' merging into '" + dst_name + "'");
+			if(fstatat(dst_fd, n.c_str(), &dst_s, AT_SYMLINK_NOFOLLOW)) {
+				// to be moved as a whole
+				if(check_only && errno == ENOENT)
+					continue;
+				throw std::runtime_error(std::string("Can't stat '") + n + "' merging into '" + dst_name + "'");
+			}
+			if(S_ISDIR(src_s.st_mode) && S_ISDIR(dst_s.st_mode)) {
+				const int	sub_src = openat(src_fd, n.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW),
+						sub_dst = openat(dst_fd, n.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+				if(-1 == sub_src || -1 == sub_dst) {
+					if(-1 != sub_src) close(sub_src);
+					if(-1 != sub_dst) close(sub_dst);
+					throw std::runtime_error(std::string("Can't open '") + n + "' merging into '" + dst_name + "'");
+				}
+				try {
+					merge_dir_fd(sub_src, sub_dst, dst_name + '/' + n, check_only);
+				} catch(...) {
+					close(sub_src);
+					close(sub_dst);
+					throw;
+				}
+				close(sub_src);
+				close(sub_dst);
+				if(!check_only)
+					unlinkat(src_fd, n.c_str(), AT_REMOVEDIR);
+			} else if(!S_ISDIR(src_s.st_mode) && !S_ISDIR(dst_s.st_mode)) {
+				// atomically replaces the existing file
+				if(!check_only && renameat(src_fd, n.c_str(), dst_fd, n.c_str()))
+					throw std::runtime_error(std::string("Can't replace '") + n + "' in '" + dst_name + "'");
+			} else throw std::runtime_error(std::string("Can't replace '") + n + "' in '" + dst_name + "', one is a directory and the other is not");
+		}
 	}
+
+	// paths (relative to the Proton prefix) where
+	// the game keeps Plugins.txt
+	const char	*PFX_PLUGINS[] = {
+		"/pfx/drive_c/users/steamuser/AppData/Local/Skyrim Special Edition/Plugins.txt",
+		"/pfx/drive_c/users/steamuser/Local Settings/Application Data/Skyrim Special Edition/Plugins.txt"
+	};
 }
 
 std::vector<std::string> utils::prompt_choice(std::ostream& ostr, std::istream& istr, const std::string& q, const std::string& csv_a, const prompt_choice_mode f_mode) {
@@ -183,6 +360,129 @@ void utils::ensure_fname_path(const std::string& tgt_filename) {
 	}
 }
 
+void utils::merge_tree(const std::string& src_dir, const std::string& dst_dir, const bool check_only) {
+	const int	src_fd = open(src_dir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC),
+			dst_fd = open(dst_dir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(-1 == src_fd || -1 == dst_fd) {
+		if(-1 != src_fd) close(src_fd);
+		if(-1 != dst_fd) close(dst_fd);
+		throw std::runtime_error(std::string("Can't open '") + src_dir + "' or '" + dst_dir + "' to merge them");
+	}
+	try {
+		merge_dir_fd(src_fd, dst_fd, dst_dir, check_only);
+	} catch(...) {
+		close(src_fd);
+		close(dst_fd);
+		throw;
+	}
+	close(src_fd);
+	close(dst_fd);
+}
+
+void utils::remove_tree(const std::string& path) {
+	nftw(path.c_str(), [](const char* f, const struct stat*, int, struct FTW*) -> int { return remove(f); }, 64, FTW_DEPTH|FTW_PHYS);
+}
+
+utils::deploy_mode utils::parse_deploy_mode(const std::string& m) {
+	if(m == "symlink")
+		return deploy_mode::SYMLINK;
+	if(m == "hardlink")
+		return deploy_mode::HARDLINK;
+	if(m == "reflink")
+		return deploy_mode::REFLINK;
+	if(m == "fuse")
+		return deploy_mode::FUSE;
+	throw std::runtime_error(std::string("Invalid deploy mode '") + m + "' (symlink, hardlink, reflink or fuse)");
+}
+
+const char* utils::deploy_mode_name(const deploy_mode m) {
+	switch(m) {
+	case deploy_mode::HARDLINK:
+		return "hardlink";
+	case deploy_mode::REFLINK:
+		return "reflink";
+	case deploy_mode::FUSE:
+		return "fuse";
+	default:
+		break;
+	}
+	return "symlink";
+}
+
+int utils::deploy_link(const std::string& target, const std::string& path, const deploy_mode m) {
+	if(deploy_mode::SYMLINK == m)
+		return symlink(target.c_str(), path.c_str());
+	if(deploy_mode::HARDLINK == m)
+		return link(target.c_str(), path.c_str());
+	if(deploy_mode::FUSE == m)
+		return 0;
+	// reflink: the clone shares the extents of
+	// target and gets its mode and times, the
+	// latter used to verify it
+	const int	fd_in = open(target.c_str(), O_RDONLY|O_CLOEXEC);
+	if(-1 == fd_in)
+		return -1;
+	struct stat	s = {0};
+	int		fd_out = -1;
+	if(!fstat(fd_in, &s) && (-1 != (fd_out = open(path.c_str(), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, s.st_mode & 0777)))) {
+		const struct timespec	ts[2] = { s.st_atim, s.st_mtim };
+		if(ioctl(fd_out, FICLONE, fd_in) || futimens(fd_out, ts)) {
+			const int	err = errno;
+			close(fd_out);
+			unlink(path.c_str());
+			close(fd_in);
+			errno = err;
+			return -1;
+		}
+		close(fd_out);
+		close(fd_in);
+		return 0;
+	}
+	const int	err = errno;
+	close(fd_in);
+	errno = err;
+	return -1;
+}
+
+void utils::probe_deploy_mode(const std::string& src_dir, const std::string& dst_dir, const deploy_mode m) {
+	if(deploy_mode::FUSE == m)
+		return;
+	const std::string	probe = ".skyrim-pm-probe." + std::to_string(getpid()),
+				src = src_dir + probe,
+				dst = dst_dir + probe;
+	ensure_fname_path(src);
+	{
+		std::ofstream	ostr(src.c_str(), std::ios_base::binary);
+		ostr << probe;
+		if(!ostr)
+			throw std::runtime_error(std::string("Can't write '") + src + "'");
+	}
+	const int	rv = deploy_link(src, dst, m),
+			err = errno;
+	unlink(dst.c_str());
+	unlink(src.c_str());
+	if(rv)
+		throw std::runtime_error(std::string("Can't deploy from '") + src_dir + "' to '" + dst_dir + "' as " + deploy_mode_name(m) + "s [" + std::strerror(err) + "]");
+}
+
+bool utils::is_deployed(const std::string& target, const std::string& path, const deploy_mode m) {
+	if(deploy_mode::SYMLINK == m) {
+		char		r_file[1024];
+		const ssize_t	r_sz = readlink(path.c_str(), r_file, sizeof(r_file)-1);
+		return (r_sz != -1) && !target.compare(0, std::string::npos, r_file, r_sz);
+	}
+	struct stat	s_t = {0},
+			s_p = {0};
+	if(deploy_mode::FUSE == m)
+		return !stat(target.c_str(), &s_t);
+	if(stat(target.c_str(), &s_t) || lstat(path.c_str(), &s_p) || !S_ISREG(s_p.st_mode))
+		return false;
+	const bool	same_inode = (s_t.st_dev == s_p.st_dev) && (s_t.st_ino == s_p.st_ino);
+	if(deploy_mode::HARDLINK == m)
+		return same_inode;
+	return !same_inode && (s_t.st_size == s_p.st_size) && (s_t.st_mtim.tv_sec == s_p.st_mtim.tv_sec) && (s_t.st_mtim.tv_nsec == s_p.st_mtim.tv_nsec);
+}
+
 std::string utils::trim(std::string str) {
 	size_t endpos = str.find_last_not_of(" \t\n\r");
 	size_t startpos = str.find_first_not_of(" \t\n\r");
@@ -216,30 +516,114 @@ std::string utils::file_name(const std::string& f_path) {
 }
 
 std::string utils::get_skyrim_se_data(void) {
-	const char*	LOCATE_SKYRIM_SE_DATA_CMD = "locate --regex \".*steamapps/common/Skyrim Special Edition$\" | head -1";
-	const auto	rc = exec(LOCATE_SKYRIM_SE_DATA_CMD);
-	// rc may be with newline, trim it
-	return trim(rc) + "/Data";
+	const auto	cached = cache_get(CACHE_DATA);
+	if(!cached.empty() && path_exists(cached))
+		return cached;
+	for(const auto& l : steam_libraries()) {
+		const auto	rv = l + '/' + SKYRIM_SE_DIR + "/Data";
+		if(!path_exists(rv))
+			continue;
+		cache_set(CACHE_DATA, rv);
+		return rv;
+	}
+	return "";
 }
 
 std::string utils::get_skyrim_se_plugins(void) {
-	const char*	LOCATE_SKYRIM_SE_PLUGINS_CMD = "locate --regex \".*Local Settings/Application Data/Skyrim Special Edition/Plugins.txt$\" | head -1";
-	const auto	rc = exec(LOCATE_SKYRIM_SE_PLUGINS_CMD);
-	// rc may be with newline, trim it
-	const auto 	rv = trim(rc);
-	if(!rv.empty())
-		return rv;
-	const char*	LOCATE_SKYRIM_SE_PLUGINS_CMD_2 = "locate --regex \".*AppData/Local/Skyrim Special Edition/Plugins.txt$\" | head -1";
-	const auto	rc_2 = exec(LOCATE_SKYRIM_SE_PLUGINS_CMD_2);
-	return trim(rc_2);
+	const auto	cached = cache_get(CACHE_PLUGINS);
+	if(!cached.empty() && path_exists(cached))
+		return cached;
+	// the Proton prefix is in the same library
+	// where the game is installed
+	for(const auto& l : steam_libraries()) {
+		if(!path_exists(l + '/' + SKYRIM_SE_DIR))
+			continue;
+		for(const auto& p : PFX_PLUGINS) {
+			const auto	rv = l + "/steamapps/compatdata/" + SKYRIM_SE_APPID + p;
+			if(!path_exists(rv))
+				continue;
+			cache_set(CACHE_PLUGINS, rv);
+			return rv;
+		}
+	}
+	return "";
 }
 
+void utils::parallel_for(const size_t n, const std::function<void(const size_t)>& fn, const size_t chunk_sz) {
+	// items are handed out in small chunks
+	// so that slow ones (i.e. big files) won't
+	// stall a whole thread partition
+	const size_t		n_chunks = (n + chunk_sz - 1)/chunk_sz,
+				n_threads = std::min(n_chunks, static_cast<size_t>(std::max(1U, std::thread::hardware_concurrency())));
+	if(n_threads <= 1) {
+		for(size_t i = 0; i < n; ++i)
+			fn(i);
+		return;
+	}
+	std::atomic<size_t>		next(0);
+	std::exception_ptr		ex;
+	std::mutex			ex_mtx;
+	auto fn_run = [&](void) -> void {
+		try {
+			size_t	cur = 0;
+			while((cur = next.fetch_add(chunk_sz)) < n) {
+				const size_t	end = std::min(n, cur + chunk_sz);
+				for(size_t i = cur; i < end; ++i)
+					fn(i);
+			}
+		} catch(...) {
+			std::lock_guard<std::mutex>	l(ex_mtx);
+			if(!ex) ex = std::current_exception();
+			// stop handing out work
+			next = n;
+		}
+	};
+	std::vector<std::thread>	th;
+	for(size_t i = 1; i < n_threads; ++i)
+		th.emplace_back(fn_run);
+	fn_run();
+	for(auto& t : th)
+		t.join();
+	if(ex)
+		std::rethrow_exception(ex);
+}
+
+utils::mmap_file::mmap_file(const std::string& f_name) : fd_(open(f_name.c_str(), O_RDONLY|O_CLOEXEC)), p_(0), sz_(0) {
+	if(-1 == fd_)
+		throw std::runtime_error(std::string("Can't open file '") + f_name + "'");
+	struct stat	s = {0};
+	if(fstat(fd_, &s) || !s.st_size) {
+		close(fd_);
+		throw std::runtime_error(std::string("Can't stat file '") + f_name + "' or empty");
+	}
+	sz_ = s.st_size;
+	void	*p = mmap(0, sz_, PROT_READ, MAP_PRIVATE, fd_, 0);
+	if(MAP_FAILED == p) {
+		close(fd_);
+		throw std::runtime_error(std::string("Can't mmap file '") + f_name + "'");
+	}
+	p_ = (const uint8_t*)p;
+}
+
+void utils::mmap_file::prefetch(void) const {
+	// larger readahead and the pages loaded in the
+	// background; MADV_SEQUENTIAL is not used as it
+	// drops the pages behind, while the next pass
+	// over the file wants them cached
+	posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd_, 0, 0, POSIX_FADV_WILLNEED);
+	madvise((void*)p_, sz_, MADV_WILLNEED);
+}
+
+utils::mmap_file::~mmap_file() {
+	munmap((void*)p_, sz_);
+	close(fd_);
+}
 
-void utils::term::enable(void) {
+void utils::term::enable(const bool on) {
 	// only enable colors if the output
 	// is a terminal
-	if(isatty(fileno(stdout)) && isatty(fileno(stderr)))
-		term_enabled = true;
+	term_enabled = on && isatty(fileno(stdout)) && isatty(fileno(stderr));
 }
 
 std::string utils::term::red(const std::string& in) {
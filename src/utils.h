@@ -22,6 +22,8 @@
 #include <vector>
 #include <sstream>
 #include <iostream>
+#include <functional>
+#include <cstdint>
 #include <libxml/parser.h>
 
 namespace utils {
@@ -64,15 +66,83 @@ public:
 	extern std::vector<std::string> prompt_choice(std::ostream& ostr, std::istream& istr, const std::string& q, const std::string& csv_a, const prompt_choice_mode f_mode = prompt_choice_mode::ONE_ONLY);
 	extern bool is_yY(const std::string& in);
 	extern void ensure_fname_path(const std::string& tgt_filename);
+	// moves the content of src_dir into dst_dir with
+	// renames only: entries missing in dst_dir are moved
+	// as a whole, directories present in both get merged
+	// and files present in both replaced; src_dir is
+	// left empty. With check_only nothing is moved, it
+	// throws if the merge would fail on a conflict (a
+	// file replacing a directory or vice versa) or on
+	// a directory which can't be written
+	extern void merge_tree(const std::string& src_dir, const std::string& dst_dir, const bool check_only = false);
+	// removes path, recursively if a directory
+	extern void remove_tree(const std::string& path);
+
+	// how the real files of the override directory
+	// get deployed into Data: hard links and reflinks
+	// (FICLONE) need both on the same filesystem, fuse
+	// deploys nothing and leaves the overlay to the
+	// --fuse-mount view
+	enum class deploy_mode {
+		SYMLINK = 0,
+		HARDLINK,
+		REFLINK,
+		FUSE
+	};
+
+	extern deploy_mode parse_deploy_mode(const std::string& m);
+	extern const char* deploy_mode_name(const deploy_mode m);
+	// deploys the real file target at path, as symlink()
+	// returns 0 on success or -1 setting errno; a no-op
+	// for fuse
+	extern int deploy_link(const std::string& target, const std::string& path, const deploy_mode m);
+	// checks path is a deployment of target: a symlink
+	// to it, the same inode or, for reflinks, a distinct
+	// regular file with the same size and mtime; with
+	// fuse only that target exists
+	extern bool is_deployed(const std::string& target, const std::string& path, const deploy_mode m);
+	// deploys a temporary file of src_dir into dst_dir,
+	// throwing if mode m is not supported between them
+	extern void probe_deploy_mode(const std::string& src_dir, const std::string& dst_dir, const deploy_mode m);
 	extern std::string trim(std::string str);
 	extern std::string path2unix(const std::string& in);
 	extern std::string to_lower(const std::string& in);
 	extern std::string file_name(const std::string& f_path);
 	extern std::string get_skyrim_se_data(void);
 	extern std::string get_skyrim_se_plugins(void);
+	// runs fn(i) for each i in [0, n) across all the
+	// available cores, handing out chunk_sz items at
+	// a time; the first exception thrown by any fn is
+	// rethrown once all threads are done
+	extern void parallel_for(const size_t n, const std::function<void(const size_t)>& fn, const size_t chunk_sz = 64);
+
+	// read only mapping of a whole file; only
+	// the pages actually accessed get loaded
+	class mmap_file {
+		int		fd_;
+		const uint8_t	*p_;
+		size_t		sz_;
+
+		mmap_file(const mmap_file&) = delete;
+		mmap_file& operator=(const mmap_file&) = delete;
+public:
+		mmap_file(const std::string& f_name);
+		// hints the whole file is going to be read,
+		// in order and possibly more than once
+		void prefetch(void) const;
+		~mmap_file();
+
+		const uint8_t* data(void) const {
+			return p_;
+		}
+
+		size_t size(void) const {
+			return sz_;
+		}
+	};
 
 	namespace term {
-		extern void enable(void);
+		extern void enable(const bool on = true);
 		std::string red(const std::string& in);
 		std::string blue(const std::string& in);
 		std::string green(const std::string& in);
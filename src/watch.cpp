@@ -0,0 +1,235 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#include "watch.h"
+#include "utils.h"
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	const uint32_t	WATCH_MASK = IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_MODIFY|IN_ATTRIB|IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF;
+
+	// the staging directories and the store are
+	// written by skyrim-pm itself, what lands in
+	// Data or the overrides gets seen when moved
+	bool skip_name(const char* n) {
+		return !std::strcmp(n, ".skyrim-pm-stage") || !std::strcmp(n, ".store");
+	}
+
+	bool is_root(const std::vector<std::string>& roots, const std::string& dir) {
+		return std::find(roots.begin(), roots.end(), dir) != roots.end();
+	}
+}
+
+watch::dirty_set::dirty_set(const std::vector<std::string>& roots) : roots_(roots), all_(true), lost_(false), gen_(0), all_gen_(0) {
+}
+
+const std::vector<std::string>& watch::dirty_set::roots(void) const {
+	return roots_;
+}
+
+void watch::dirty_set::set_all(void) {
+	all_ = true;
+	all_gen_ = ++gen_;
+}
+
+void watch::dirty_set::set_lost(void) {
+	lost_ = true;
+	set_all();
+}
+
+void watch::dirty_set::add(const std::string& p) {
+	paths_[p] = ++gen_;
+}
+
+uint64_t watch::dirty_set::generation(void) const {
+	return gen_;
+}
+
+void watch::dirty_set::clear(const uint64_t upto) {
+	if(all_ && all_gen_ <= upto && !lost_)
+		all_ = false;
+	for(auto it = paths_.begin(); it != paths_.end(); ) {
+		if(it->second <= upto)
+			it = paths_.erase(it);
+		else
+			++it;
+	}
+}
+
+bool watch::dirty_set::all(void) const {
+	return all_;
+}
+
+bool watch::dirty_set::is_dirty(const std::string& p) const {
+	if(all_)
+		return true;
+	if(paths_.empty())
+		return false;
+	if(paths_.find(p) != paths_.end())
+		return true;
+	// then all the parent directories
+	std::string	parent(p);
+	for(auto p_slash = parent.rfind('/'); p_slash != std::string::npos && p_slash > 0; p_slash = parent.rfind('/')) {
+		parent.resize(p_slash);
+		if(paths_.find(parent) != paths_.end())
+			return true;
+	}
+	return false;
+}
+
+void watch::dirty_set::for_each(const std::string& dir, const std::function<void(const std::string&)>& fn) const {
+	for(const auto& i : paths_) {
+		if(!i.first.compare(0, dir.length(), dir))
+			fn(i.first);
+	}
+}
+
+watch::tracker::tracker(dirty_set& ds, const std::vector<std::string>& paths) : ds_(ds), paths_(paths), fd_(inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) {
+	if(fd_ == -1)
+		throw std::runtime_error(std::string("Can't initialize inotify [") + std::strerror(errno) + "]");
+	if(paths_.size() != ds_.roots().size()) {
+		close(fd_);
+		throw std::runtime_error("Can't watch, a path is needed for each root");
+	}
+	for(const auto& r : ds_.roots())
+		add_tree(r);
+	LOG << "Watching " << wds_.size() << " directories";
+}
+
+std::string watch::tracker::real_dir(const std::string& dir) const {
+	// the longest matching root, in
+	// case one is under the other
+	const auto&	roots = ds_.roots();
+	size_t		idx = roots.size();
+	for(size_t i = 0; i < roots.size(); ++i) {
+		if(!dir.compare(0, roots[i].length(), roots[i]) && (idx == roots.size() || roots[i].length() > roots[idx].length()))
+			idx = i;
+	}
+	return (idx == roots.size()) ? dir : paths_[idx] + dir.substr(roots[idx].length());
+}
+
+void watch::tracker::add_tree(const std::string& dir) {
+	const std::string	r_dir = real_dir(dir);
+	const int		wd = inotify_add_watch(fd_, r_dir.c_str(), WATCH_MASK|IN_ONLYDIR|IN_DONT_FOLLOW);
+	if(wd == -1) {
+		const int	err = errno;
+		// a subdirectory gone meanwhile, the parent
+		// has the event; a root has no parent
+		if((err == ENOENT || err == ENOTDIR) && !is_root(ds_.roots(), dir))
+			return;
+		// i.e. out of watches (fs.inotify.max_user_watches)
+		LOG << "Can't watch '" << r_dir << "' [" << std::strerror(err) << "], changes can't be tracked";
+		ds_.set_lost();
+		return;
+	}
+	wds_[wd] = dir;
+	std::unique_ptr<DIR, int(*)(DIR*)>	d(opendir(r_dir.c_str()), closedir);
+	if(!d)
+		return;
+	const bool	root = is_root(ds_.roots(), dir);
+	struct dirent	*de = 0;
+	while((de = readdir(d.get()))) {
+		if(DT_DIR != de->d_type || !std::strcmp(de->d_name, ".") || !std::strcmp(de->d_name, ".."))
+			continue;
+		if(root && skip_name(de->d_name))
+			continue;
+		add_tree(dir + de->d_name + '/');
+	}
+}
+
+void watch::tracker::rm_tree(const std::string& dir) {
+	for(auto it = wds_.begin(); it != wds_.end(); ) {
+		if(!it->second.compare(0, dir.length(), dir)) {
+			inotify_rm_watch(fd_, it->first);
+			it = wds_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+int watch::tracker::fd(void) const {
+	return fd_;
+}
+
+bool watch::tracker::drain(void) {
+	alignas(inotify_event) char	buf[64*1024];
+	bool				changed = false;
+	while(true) {
+		const ssize_t	rd = read(fd_, buf, sizeof(buf));
+		if(rd < 0 && errno == EINTR)
+			continue;
+		if(rd <= 0)
+			break;
+		for(const char *p = buf; p < buf + rd; ) {
+			const inotify_event	*ev = (const inotify_event*)p;
+			p += sizeof(inotify_event) + ev->len;
+			// the kernel queue was full, some
+			// changes got lost
+			if(ev->mask & IN_Q_OVERFLOW) {
+				LOG << "inotify queue overflow, all paths are now changed";
+				ds_.set_all();
+				changed = true;
+				continue;
+			}
+			const auto	it = wds_.find(ev->wd);
+			if(it == wds_.end())
+				continue;
+			const std::string	dir = it->second;
+			if(ev->mask & IN_IGNORED) {
+				wds_.erase(it);
+				continue;
+			}
+			if(ev->len) {
+				if(is_root(ds_.roots(), dir) && skip_name(ev->name))
+					continue;
+				const std::string	path = dir + ev->name;
+				ds_.add(path);
+				changed = true;
+				// directories moved or created get
+				// watched too, moved away ones not
+				if(ev->mask & IN_ISDIR) {
+					if(ev->mask & (IN_CREATE|IN_MOVED_TO))
+						add_tree(path + '/');
+					else if(ev->mask & IN_MOVED_FROM)
+						rm_tree(path + '/');
+				}
+			} else if(ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF)) {
+				if(is_root(ds_.roots(), dir)) {
+					LOG << "Watched directory '" << dir << "' gone, changes can't be tracked";
+					ds_.set_lost();
+				} else {
+					ds_.add(dir.substr(0, dir.length()-1));
+				}
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+watch::tracker::~tracker() {
+	close(fd_);
+}
@@ -0,0 +1,90 @@
+/*
+    This file is part of skyrim-pm.
+
+    skyrim-pm is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    skyrim-pm is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with skyrim-pm.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+namespace watch {
+	// paths (absolute) under Data and the override
+	// directory modified since the overlay was last
+	// found correctly deployed; a directory stands for
+	// all its content. Until then, or when changes got
+	// lost, 'all' is set and everything has to be checked
+	class dirty_set {
+		std::vector<std::string>			roots_;
+		bool						all_,
+								lost_;
+		uint64_t					gen_,
+								all_gen_;
+		std::unordered_map<std::string, uint64_t>	paths_;
+public:
+		// roots are '/' terminated
+		dirty_set(const std::vector<std::string>& roots);
+		const std::vector<std::string>& roots(void) const;
+		void set_all(void);
+		// changes can't be tracked anymore (i.e. a
+		// root can't be watched), 'all' stays set
+		void set_lost(void);
+		void add(const std::string& p);
+		// each change gets a generation, to drop
+		// only the ones seen before a check
+		uint64_t generation(void) const;
+		void clear(const uint64_t upto);
+		bool all(void) const;
+		// true if p or one of its parents changed
+		bool is_dirty(const std::string& p) const;
+		// invokes fn with the changed paths under dir
+		void for_each(const std::string& dir, const std::function<void(const std::string&)>& fn) const;
+	};
+
+	// inotify watches on all the directories under the
+	// roots of the dirty_set, adding what changes to it;
+	// each root is watched where its content is, the
+	// matching entry of 'paths' (i.e. Data resolved
+	// when a symlink), the changes are still recorded
+	// under the root itself
+	class tracker {
+		dirty_set&				ds_;
+		const std::vector<std::string>		paths_;
+		int					fd_;
+		std::unordered_map<int, std::string>	wds_;
+
+		tracker(const tracker&) = delete;
+		tracker& operator=(const tracker&) = delete;
+
+		std::string real_dir(const std::string& dir) const;
+		void add_tree(const std::string& dir);
+		void rm_tree(const std::string& dir);
+public:
+		// paths are '/' terminated, as the roots
+		tracker(dirty_set& ds, const std::vector<std::string>& paths);
+		int fd(void) const;
+		// reads the pending events, returns true
+		// if any got added to the dirty_set
+		bool drain(void);
+		~tracker();
+	};
+}
+
+#endif //_WATCH_H_